@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <chrono>
+#include <thread>
+
+#include <poll.h>
+#include <timeout.h>
+#include <async.h>
+#include <when.h>
+#include <channel.h>
+#include <promise.h>
+#include <stream.h>
+
+// 主机上的调度器基准测试
+
+// 统计全局堆分配次数
+static u64 _heap_allocs = 0;
+void *operator new(size_t size) {
+    _heap_allocs++;
+    if (void *p = malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static u64 now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 投递队列压力测试: 4个生产者线程并发post, 轮询循环消费
+struct PostBench {
+    static constexpr int PRODUCERS = 4;
+    static constexpr u32 PER_PRODUCER = 250000;
+    u32 consumed = 0;
+    u64 retries[PRODUCERS] = {};
+    u64 start_us = 0;
+    std::thread threads[PRODUCERS];
+};
+
+static void bench_post_consume(void *arg) {
+    auto b = (PostBench *)arg;
+    if (++b->consumed < PostBench::PRODUCERS * PostBench::PER_PRODUCER)
+        return;
+    u64 us = now_us() - b->start_us;
+    u64 retries = 0;
+    for (int i = 0; i < PostBench::PRODUCERS; ++i) {
+        b->threads[i].join();
+        retries += b->retries[i];
+    }
+    auto &st = get_poll_stats();
+    printf("post: %d producers, %u items, %llu us, %.2f Mitems/s, queue full %llu times (overflows %u)\n",
+           PostBench::PRODUCERS, b->consumed, (unsigned long long)us, b->consumed / (double)us,
+           (unsigned long long)retries, (unsigned)st.post_overflows);
+}
+
+static void bench_post() {
+    PostBench bench;
+    auto b = &bench;
+    b->start_us = now_us();
+    for (int i = 0; i < PostBench::PRODUCERS; ++i) {
+        b->threads[i] = std::thread([b, i] {
+            for (u32 n = 0; n < PostBench::PER_PRODUCER; ++n) {
+                // 队列满时让出, 由轮询循环消费后重试
+                while (!post(bench_post_consume, b)) {
+                    b->retries[i]++;
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    run_until([b] { return b->consumed == PostBench::PRODUCERS * PostBench::PER_PRODUCER; });
+}
+
+// 嵌套co_await链: 叶子挂起一轮后恢复, 测量从叶子恢复逐层返回到最外层的开销
+static Async<int> chain(int depth) {
+    if (depth == 0) {
+        co_await yield_now();
+        co_return 0;
+    }
+    co_return co_await chain(depth - 1) + 1;
+}
+
+// 对照: 对称转移之前, 每层co_await登记一个轮询节点, 子协程结束时唤醒它, 每层多一轮循环.
+// 用等待Promise(挂起的节点在下一轮恢复)重现这种方式, 基线与当前实现在同一次运行中测量
+static Async<void> settle_with(Async<int> child, Promise<int>::Resolver resolve) {
+    resolve(co_await child);
+}
+
+static Async<int> node_chain(int depth) {
+    if (depth == 0) {
+        co_await yield_now();
+        co_return 0;
+    }
+    Promise<int> child([depth](const Promise<int>::Resolver &resolve) {
+        settle_with(node_chain(depth - 1), resolve).detach();
+    });
+    co_return *co_await child + 1;
+}
+
+struct ChainBench {
+    static constexpr int DEPTH = 16;
+    static constexpr int ROUNDS = 20000;
+    Async<int> (*chain)(int);
+    bool done = false;
+};
+
+static Async<void> chain_driver(ChainBench *b) {
+    for (int i = 0; i < ChainBench::ROUNDS; ++i) {
+        int depth = co_await b->chain(ChainBench::DEPTH);
+        if (depth != ChainBench::DEPTH)
+            printf("async chain: bad depth %d\n", depth);
+    }
+    b->done = true;
+}
+
+static void bench_async_chain() {
+    const char *names[] = {"symmetric transfer", "node per await (baseline)"};
+    Async<int> (*chains[])(int) = {chain, node_chain};
+    for (int i = 0; i < 2; ++i) {
+        ChainBench bench{chains[i]};
+        auto b = &bench;
+        u64 start = now_us();
+        start_task_async([b](Task *) { return chain_driver(b); });
+        RunResult r = run_until([b] { return b->done; });
+        u64 us = now_us() - start;
+        printf("async chain, %s: depth %d, %d rounds, %.3f us/round, %.1f passes/round, %.1f callbacks/round\n",
+               names[i], ChainBench::DEPTH, ChainBench::ROUNDS, us / (double)ChainBench::ROUNDS,
+               r.iterations / (double)ChainBench::ROUNDS, r.work / (double)ChainBench::ROUNDS);
+    }
+}
+
+// 内存浸泡测试: 循环中等待1000万次子协程, 存活帧数和内存池大小应保持不变
+static Async<int> soak_add(int x) {
+    co_return x + 1;
+}
+
+static Async<void> soak_driver(int count, int *result) {
+    for (int i = 0; i < count; ++i)
+        *result = co_await soak_add(*result);
+}
+
+static void bench_async_soak() {
+    constexpr int CALLS = 10000000;
+    int result = 0;
+    u64 start = now_us();
+    start_task_async([&result](Task *) { return soak_driver(CALLS, &result); });
+    run_until([&result] { return result == CALLS; });
+    u64 us = now_us() - start;
+    auto &st = get_frame_stats();
+    printf("async soak: %d awaited calls, %.1f ns/call, frames live %u, peak %u, pool %u bytes\n", result,
+           us * 1000.0 / CALLS, (unsigned)st.live, (unsigned)st.peak, (unsigned)st.pool_bytes);
+}
+
+// 扇出汇合: 每轮等待64个各挂起一轮的子协程, 汇合不应增加回调数
+static Async<int> fan_child(int x) {
+    co_await yield_now();
+    co_return x;
+}
+
+struct FanBench {
+    static constexpr int FAN = 64;
+    static constexpr int ROUNDS = 5000;
+    bool done = false;
+};
+
+static Async<void> fan_driver(FanBench *b) {
+    for (int i = 0; i < FanBench::ROUNDS; ++i) {
+        Vec<Async<int>> children;
+        for (int k = 0; k < FanBench::FAN; ++k)
+            children.push_back(fan_child(k));
+        Vec<int> results = co_await when_all(std::move(children));
+        if (results.back() != FanBench::FAN - 1)
+            printf("when_all: bad result %d\n", results.back());
+    }
+    b->done = true;
+}
+
+static void bench_when_all() {
+    FanBench bench;
+    auto b = &bench;
+    u64 start = now_us();
+    start_task_async([b](Task *) { return fan_driver(b); });
+    RunResult r = run_until([b] { return b->done; });
+    u64 us = now_us() - start;
+    printf("when_all: fan %d, %d rounds, %.3f us/round, %.1f passes/round, %.1f callbacks/round\n",
+           FanBench::FAN, FanBench::ROUNDS, us / (double)FanBench::ROUNDS,
+           r.iterations / (double)FanBench::ROUNDS, r.work / (double)FanBench::ROUNDS);
+}
+
+// 通道乒乓: 两个协程经容量为1的两个通道来回传递, 每次传递双方各挂起一次
+static Async<void> ping(Channel<int> out, Channel<int> in, int rounds, bool *done) {
+    for (int i = 0; i < rounds; ++i) {
+        co_await out.send(i);
+        Optional<int> v = co_await in.recv();
+        if (!v || *v != i)
+            printf("channel: bad pong\n");
+    }
+    out.close();
+    *done = true;
+}
+
+static Async<void> pong(Channel<int> in, Channel<int> out) {
+    while (Optional<int> v = co_await in.recv())
+        co_await out.send(std::move(*v));
+}
+
+static void bench_channel() {
+    constexpr int ROUNDS = 200000;
+    Channel<int> a(1), b(1);
+    bool done = false;
+    u32 heap = inplace_func_heap_count();
+    u64 start = now_us();
+    start_task_async([&](Task *) { return ping(a, b, ROUNDS, &done); });
+    start_task_async([&](Task *) { return pong(a, b); });
+    RunResult r = run_until([&done] { return done; });
+    u64 us = now_us() - start;
+    printf("channel ping-pong: %d round trips, %.1f ns/round trip, %.2f Mmsgs/s, %.1f passes/round trip, "
+           "callback heap allocs %u\n",
+           ROUNDS, us * 1000.0 / ROUNDS, 2.0 * ROUNDS / us, r.iterations / (double)ROUNDS,
+           (unsigned)(inplace_func_heap_count() - heap));
+    run_once();
+}
+
+// 睡眠/让出: 1000个协程交替sleep_ms(1)和yield_now, 虚拟时钟下测量每次挂起恢复的开销
+static Async<void> sleeper(int rounds, int *done) {
+    for (int i = 0; i < rounds; ++i) {
+        co_await sleep_ms(1);
+        co_await yield_now();
+    }
+    ++*done;
+}
+
+static void bench_sleep() {
+    constexpr int TASKS = 1000;
+    constexpr int ROUNDS = 1000;
+    int done = 0;
+    use_virtual_clock();
+    u32 heap = inplace_func_heap_count();
+    u32 slots = get_poll_stats().node_slots;
+    u64 start = now_us();
+    for (int i = 0; i < TASKS; ++i)
+        start_task_async([&done](Task *) { return sleeper(ROUNDS, &done); });
+    run_until([&done] { return done == TASKS; });
+    u64 us = now_us() - start;
+    use_system_clock();
+    printf("sleep/yield: %d tasks x %d rounds, %.1f ns/suspend, callback heap allocs %u, node slots +%u\n", TASKS,
+           ROUNDS, us * 1000.0 / (2.0 * TASKS * ROUNDS), (unsigned)(inplace_func_heap_count() - heap),
+           (unsigned)(get_poll_stats().node_slots - slots));
+    run_once();
+}
+
+// Promise/Stream共享状态: 创建, 保存解决器, 完成, 读取结果, 释放; 以及经过then的一级延续
+static void bench_promise() {
+    constexpr int COUNT = 1000000;
+    u64 sum = 0;
+    u64 allocs = _heap_allocs;
+    u64 start = now_us();
+    for (int i = 0; i < COUNT; ++i) {
+        Promise<int>::ResolveFunc resolve;
+        Promise<int> p([&resolve](auto r) { resolve = r; });
+        resolve(i);
+        sum += p.result();
+    }
+    u64 create_us = now_us() - start;
+    allocs = _heap_allocs - allocs;
+
+    constexpr int CHAINS = 100000;
+    int done = 0;
+    start = now_us();
+    for (int i = 0; i < CHAINS; ++i)
+        Promise<int>([i](auto r) { r(i); }).then([&done](int) { done++; });
+    run_until([&done] { return done == CHAINS; });
+    u64 chain_us = now_us() - start;
+
+    start = now_us();
+    for (int i = 0; i < COUNT; ++i) {
+        Stream<int> s(2, [&sum](Stream<int>::Producer producer) { producer.send(1); });
+        sum += s.consumer()->buf.front();
+    }
+    u64 stream_us = now_us() - start;
+    printf("promise: %.1f ns/create+resolve, %.2f heap allocs/create, %.1f ns/then, stream %.1f ns/create+send, "
+           "state %u bytes (check %llu)\n",
+           create_us * 1000.0 / COUNT, allocs / (double)COUNT, chain_us * 1000.0 / CHAINS,
+           stream_us * 1000.0 / COUNT, (unsigned)sizeof(RcPool<Promise<int>::Future>::Block), (unsigned long long)sum);
+}
+
+int main() {
+    printf("========== Lib MCU Async Bench ==========\n");
+    bench_async_chain();
+    bench_async_soak();
+    bench_when_all();
+    bench_channel();
+    bench_sleep();
+    bench_promise();
+    bench_post();
+    return 0;
+}
@@ -78,10 +78,11 @@ void main_task(Task *task) {
         }
     });
 
-    // set a poll task to handle non-blocking stdin input
-    set_poll([=] {
-        int c = nonblocking_getchar();
-        if (c != EOF) {
+    // check non-blocking stdin every 10ms, emulate uart rx interrupt,
+    // the loop sleeps in between when nothing else is ready
+    set_interval(10, [=] {
+        int c;
+        while ((c = nonblocking_getchar()) != EOF) {
             uart->uart_intput(c);
         }
     });
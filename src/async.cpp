@@ -1,6 +1,7 @@
 #include "async.h"
 #include <console.h>
 #include <promise.h>
+#include <assert.h>
 
 
 #if __cplusplus >= 202002L
@@ -30,14 +31,100 @@ Async<int> func1(Env e) {
     co_await sleep_ms(1000);
     e.io().printf("hello2\n");
     co_await func2(e);
-    int x = co_await start_int_promise(97);
+    int x = *co_await start_int_promise(97);
     e.io().printf("%d\n", x);
     co_return 9;
 }
 
 
 void cmd_test_async(Env e) {
-    func1(e);
+    func1(e).detach();
+}
+
+static Async<int> nested(int depth) {
+    if (depth == 0) {
+        co_await yield_now();
+        co_return 0;
+    }
+    co_return co_await nested(depth - 1) + 1;
+}
+
+static Async<void> nested_driver(int *result) {
+    *result = co_await nested(8);
+}
+
+static Async<void> sleep_loop(int count, int *done) {
+    for (int i = 0; i < count; ++i) {
+        co_await sleep_ms(1);
+        co_await yield_now();
+        ++*done;
+    }
+}
+
+static Async<int> add_one(int x) {
+    co_return x + 1;
+}
+
+static Async<void> soak_driver(int count, int *result, u32 *max_live, u32 *pool_grow) {
+    u32 pool_bytes = 0;
+    for (int i = 0; i < count; ++i) {
+        *result = co_await add_one(*result);
+        if (get_frame_stats().live > *max_live)
+            *max_live = get_frame_stats().live;
+        // 第一次调用后内存池不再增长
+        if (i == 0)
+            pool_bytes = get_frame_stats().pool_bytes;
+        *pool_grow = get_frame_stats().pool_bytes - pool_bytes;
+    }
+}
+
+void _test_async() {
+    printf("Test Async\n");
+    // 嵌套co_await: 叶子恢复后逐层直接返回, 不经过轮询节点, 一轮内完成
+    int result = -1;
+    start_task_async([&result](Task *) { return nested_driver(&result); });
+    RunResult r = run_once();
+    assert(result == -1 && r.work == 1);
+    r = run_once();
+    assert(result == 8 && r.work == 1);
+    run_once();
+    assert(get_frame_stats().live == 0);
+
+    // 惰性启动: 未等待就丢弃的协程不执行, 帧随Async析构释放
+    {
+        int dropped = -1;
+        auto a = nested_driver(&dropped);
+        assert(get_frame_stats().live == 1);
+    }
+    assert(get_frame_stats().live == 0);
+
+    // 循环中等待子协程, 每次取出结果后立即释放帧, 存活帧数不增长
+    int sum = 0;
+    u32 max_live = 0;
+    u32 pool_grow = 0;
+    start_task_async([&](Task *) { return soak_driver(100000, &sum, &max_live, &pool_grow); });
+    run_once();
+    assert(sum == 100000 && max_live == 1); // 每次等待后只剩驱动协程自身
+    assert(pool_grow == 0);
+    assert(get_frame_stats().live == 0);
+    run_once();
+
+    // 睡眠与让出不分配内存: 节点槽位复用, 回调不退回堆上
+    use_virtual_clock();
+    int slept = 0;
+    start_task_async([&slept](Task *) { return sleep_loop(10, &slept); });
+    run_for(50);
+    u32 slots = get_poll_stats().node_slots;
+    u32 heap = inplace_func_heap_count();
+    u32 pool = get_frame_stats().pool_bytes;
+    start_task_async([&slept](Task *) { return sleep_loop(1000, &slept); });
+    run_for(2000);
+    assert(slept == 1010);
+    assert(get_poll_stats().node_slots == slots);
+    assert(inplace_func_heap_count() == heap);
+    assert(get_frame_stats().pool_bytes == pool);
+    use_system_clock();
+    printf("Test Async PASS\n");
 }
 
 #endif // __cplusplus >= 202002L
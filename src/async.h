@@ -3,25 +3,82 @@
 
 #if __cplusplus >= 202002L
 
+#include <cassert>
 #include <coroutine>
 #include <exception>
+#include <utility>
 #include <poll.h>
 #include <timeout.h>
+#include <frame_pool.h>
 
-template <typename T> struct Async {
-    struct promise_type {
+// Async的所有权:
+// - 协程创建后停在起点, 第一次co_await时才开始执行, Async对象拥有协程帧
+// - co_await取出结果后立即销毁帧, 未被等待就丢弃的Async在析构时销毁帧
+// - 不需要结果时调用detach()立即启动, 协程结束时自行销毁; 所属任务先结束时由任务销毁
+// Async标记为[[nodiscard]]: 既不等待也不detach的调用不会执行, 编译时给出警告
+struct AsyncPromiseBase {
+    std::coroutine_handle<> continuation; // 等待本协程的协程
+    Task *task = nullptr;                 // detach时所在的任务
+    Task::DeletorId deletor;
+    bool detached = false;
+    bool starting = false;                // 正在由await_suspend同步启动
+
+    // 协程帧从按大小分级的内存池分配
+    static void *operator new(size_t size) { return frame_alloc(size); }
+    static void operator delete(void *p) { frame_free(p); }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    void unhandled_exception() {
+        auto eptr = std::current_exception();
+        try {
+            if (eptr) {
+                std::rethrow_exception(eptr);
+            }
+        } catch (const std::exception &e) {
+            printf("Async: [unhandled_exception] what(): %s\n", e.what());
+        } catch (...) {
+            printf("Async: [unhandled_exception] unknown exception\n");
+        }
+    }
+};
+
+// 协程结束时通过对称转移直接恢复等待它的协程, 不经过轮询节点; detach的协程销毁自身.
+// 在启动过程中同步结束时不转移, 由await_suspend返回false继续执行等待者, 避免循环中同步的co_await逐次加深调用栈
+struct AsyncFinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename P> std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+        AsyncPromiseBase &p = h.promise();
+        if (p.continuation)
+            return p.starting ? std::noop_coroutine() : p.continuation;
+        if (p.detached) {
+            if (p.task)
+                p.task->remove_deletor(p.deletor);
+            h.destroy();
+        }
+        return std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+};
+
+inline void async_detach(std::coroutine_handle<> h, AsyncPromiseBase &p) {
+    p.detached = true;
+    if (auto task = get_current_task()) {
+        p.task = task.get();
+        p.deletor = task->install_deletor([h] { h.destroy(); });
+    }
+    h.resume();
+}
+
+template <typename T> struct [[nodiscard]] Async {
+    struct promise_type : AsyncPromiseBase {
         T result;
 
         Async get_return_object() {
-            auto handle = std::coroutine_handle<promise_type>::from_promise(*this);
-            get_current_task()->install_deletor([handle]{
-                handle.destroy();
-            });
-            return Async{handle};
+            return Async{std::coroutine_handle<promise_type>::from_promise(*this)};
         }
 
-        std::suspend_never initial_suspend() { return {}; }
-        std::suspend_always final_suspend() noexcept { return {}; }
+        AsyncFinalAwaiter final_suspend() noexcept { return {}; }
         template <typename U> std::suspend_always yield_value(U &&value) {
             result = std::forward<U>(value);
             return {};
@@ -29,89 +86,117 @@ template <typename T> struct Async {
         template <typename U> void return_value(U &&value) {
             result = std::forward<U>(value);
         }
-
-        void unhandled_exception() {
-            auto eptr = std::current_exception();
-            try {
-                if (eptr) {
-                    std::rethrow_exception(eptr);
-                }
-            } catch (const std::exception &e) {
-                printf("Async: [unhandled_exception] what(): %s\n", e.what());
-            } catch (...) {
-                printf("Async: [unhandled_exception] unknown exception\n");
-            }
-        }
     };
     std::coroutine_handle<promise_type> handle;
+
+    Async() = default;
+    explicit Async(std::coroutine_handle<promise_type> h) : handle(h) {}
+    Async(Async &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Async &operator=(Async &&other) noexcept {
+        if (this != &other) {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    ~Async() { reset(); }
+
+    void reset() {
+        if (handle) {
+            handle.destroy();
+            handle = nullptr;
+        }
+    }
     T result() const { return handle.promise().result; }
+    // 不等待结果, 立即启动. 已移走或已detach的Async上调用是错误, 发布版本中忽略
+    void detach() {
+        assert(handle && "detach on empty Async");
+        if (!handle)
+            return;
+        auto h = std::exchange(handle, nullptr);
+        async_detach(h, h.promise());
+    }
 
     auto operator co_await() {
         struct Awaiter {
-            std::coroutine_handle<promise_type> handle;
-            bool await_ready() const { return handle.done(); }
-            void await_suspend(std::coroutine_handle<> awaiting) {
-                set_poll([this, awaiting](Poll p) {
-                    if (handle.done()) {
-                        awaiting.resume();
-                        p.remove();
-                    }
-                });
+            Async *self;
+            bool await_ready() const { return false; }
+            bool await_suspend(std::coroutine_handle<> awaiting) {
+                // 启动子协程, 同步结束时不挂起; 否则子协程结束时在final_suspend中直接恢复awaiting
+                auto &p = self->handle.promise();
+                p.continuation = awaiting;
+                p.starting = true;
+                self->handle.resume();
+                p.starting = false;
+                return !self->handle.done();
             }
             T await_resume() {
-                get_current_task()->terminal();
-
-                return handle.promise().result;
-                // T result = handle.promise().result;
-                // handle.destroy(); use poll to destroy
-                // return result;
+                T result = std::move(self->handle.promise().result);
+                self->reset();
+                return result;
             }
         };
-        return Awaiter{handle};
+        return Awaiter{this};
     }
 };
 
-#include <exception>
-template <> struct Async<void> {
-    struct promise_type {
+template <> struct [[nodiscard]] Async<void> {
+    struct promise_type : AsyncPromiseBase {
         Async get_return_object() {
-            auto handle = std::coroutine_handle<promise_type>::from_promise(*this);
-            get_current_task()->install_deletor([handle]{
-                handle.destroy();
-            });
-            return Async{handle};
+            return Async{std::coroutine_handle<promise_type>::from_promise(*this)};
         }
 
-        std::suspend_never initial_suspend() { return {}; }
-
-        std::suspend_always final_suspend() noexcept { return {}; }
+        AsyncFinalAwaiter final_suspend() noexcept { return {}; }
 
         void return_void() {}
-
-        void unhandled_exception() {
-        	printf("Async: [unhandled_exception] unknown exception\n");
-        }
     };
     std::coroutine_handle<promise_type> handle;
 
+    Async() = default;
+    explicit Async(std::coroutine_handle<promise_type> h) : handle(h) {}
+    Async(Async &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Async &operator=(Async &&other) noexcept {
+        if (this != &other) {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    ~Async() { reset(); }
+
+    void reset() {
+        if (handle) {
+            handle.destroy();
+            handle = nullptr;
+        }
+    }
+    // 不等待结果, 立即启动. 已移走或已detach的Async上调用是错误, 发布版本中忽略
+    void detach() {
+        assert(handle && "detach on empty Async");
+        if (!handle)
+            return;
+        auto h = std::exchange(handle, nullptr);
+        async_detach(h, h.promise());
+    }
+
     auto operator co_await() {
         struct Awaiter {
-            std::coroutine_handle<promise_type> handle;
-            bool await_ready() const { return handle.done(); }
-            void await_suspend(std::coroutine_handle<> awaiting) {
-                set_poll([this, awaiting](Poll p) {
-                    if (handle.done()) {
-                        awaiting.resume();
-                        p.remove();
-                    }
-                });
+            Async *self;
+            bool await_ready() const { return false; }
+            bool await_suspend(std::coroutine_handle<> awaiting) {
+                // 启动子协程, 同步结束时不挂起; 否则子协程结束时在final_suspend中直接恢复awaiting
+                auto &p = self->handle.promise();
+                p.continuation = awaiting;
+                p.starting = true;
+                self->handle.resume();
+                p.starting = false;
+                return !self->handle.done();
             }
             void await_resume() {
-                get_current_task()->terminal();
-                //handle.destroy(); use poll to destroy
+                self->reset();
             }
         };
-        return Awaiter{handle};
+        return Awaiter{this};
     }
 };
 
@@ -134,31 +219,61 @@ inline LoopAwaiter loop_when(const Func<bool()>& cb) {
     return LoopAwaiter { cb };
 }
 
+// 定时器/就绪节点的回调: 只捕获协程句柄, 放在节点的内联存储中.
+// 节点来自调度器的节点池, 挂起与恢复都不分配内存; 等待者只保存值, 可平凡析构.
+struct _ResumeNode {
+    std::coroutine_handle<> h;
+    void operator()(Poll) const { h.resume(); }
+};
+
 struct SleepAwaiter {
     u32 _ms;
     SleepAwaiter(u32 ms) : _ms(ms) {}
     bool await_ready() { return false; }
     void await_suspend(std::coroutine_handle<> h) {
-        set_timeout(_ms, [h]() { h.resume(); });
+        set_timer(_ms, 0, PollFunc_1(_ResumeNode{h}));
+    }
+    void await_resume() {}
+};
+
+// 让出: 下一轮恢复, 期间同一轮中的其他节点先执行
+struct YieldAwaiter {
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        set_once([h] { h.resume(); });
+    }
+    void await_resume() {}
+};
+
+struct SleepUsAwaiter {
+    u32 _us;
+    SleepUsAwaiter(u32 us) : _us(us) {}
+    bool await_ready() { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        set_timeout_us(_us, [h]() { h.resume(); });
     }
     void await_resume() {}
 };
 
 inline SleepAwaiter sleep_ms(u32 ms) { return SleepAwaiter{ms}; }
 inline SleepAwaiter sleep_sec(u32 sec) { return SleepAwaiter{sec * 1000}; }
+inline SleepUsAwaiter sleep_us(u32 us) { return SleepUsAwaiter{us}; }
+inline YieldAwaiter yield_now() { return YieldAwaiter{}; }
 
 inline void set_once_async(const Func<Async<void>()>& cb) {
     set_once([cb]{
-        (void)cb();
+        cb().detach();
     });
 }
 
 inline Shared<Task> start_task_async(const Func<Async<void>(Task*)>& cb) {
     return start_task([cb](Task* task){
-    	(void)cb(task);
+        cb(task).detach();
     });
 }
 
+extern void _test_async();
+
 #endif // __cplusplus >= 202002L
 
 #endif // ASYNC_H
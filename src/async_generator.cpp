@@ -0,0 +1,61 @@
+#include <async_generator.h>
+#include <stdio.h>
+#include <assert.h>
+#include <test_counted.h>
+
+#if __cplusplus >= 202002L
+
+static AsyncGenerator<Counted> count_to(int n) {
+    for (int i = 1; i <= n; ++i)
+        co_yield Counted(i);
+}
+
+static AsyncGenerator<int> ticks(int n, u32 ms) {
+    for (int i = 1; i <= n; ++i) {
+        co_await sleep_ms(ms);
+        co_yield i;
+    }
+}
+
+static Async<void> sum_samples(AsyncGenerator<Counted> gen, int *sum) {
+    while (const Counted *s = co_await gen.next())
+        *sum += s->value;
+}
+
+static Async<void> sum_ticks(AsyncGenerator<int> gen, int *sum, bool *done) {
+    co_await gen.for_each([sum](int v) { *sum += v; });
+    *done = true;
+}
+
+void _test_async_generator() {
+    printf("Test AsyncGenerator\n");
+    // 同步生产: 一轮内取完, 值就地交付, 不复制也不移动
+    Counted::reset();
+    int sum = 0;
+    start_task_async([&sum](Task *) { return sum_samples(count_to(100), &sum); });
+    run_once();
+    assert(sum == 5050 && Counted::copies == 0 && Counted::moves == 0);
+
+    // 异步生产: 生产者等待定时器, 消费者挂起
+    use_virtual_clock();
+    sum = 0;
+    bool done = false;
+    start_task_async([&sum, &done](Task *) { return sum_ticks(ticks(10, 100), &sum, &done); });
+    run_until([&done] { return done; });
+    assert(sum == 55);
+
+    // 生成器 -> 流 -> 生成器
+    sum = 0;
+    done = false;
+    start_task_async([&sum, &done](Task *) {
+        return sum_ticks(generator_from(stream_from(ticks(5, 10), 4)), &sum, &done);
+    });
+    run_until([&done] { return done; });
+    assert(sum == 15);
+    use_system_clock();
+    run_once();
+    assert(get_frame_stats().live == 0);
+    printf("Test AsyncGenerator PASS\n");
+}
+
+#endif // __cplusplus >= 202002L
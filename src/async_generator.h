@@ -0,0 +1,163 @@
+#ifndef ASYNC_GENERATOR_H
+#define ASYNC_GENERATOR_H
+
+#if __cplusplus >= 202002L
+
+#include <async.h>
+#include <stream.h>
+
+// 异步生成器: 生产者用co_yield产生数据, 消费者用co_await gen.next()逐个取出.
+// 数据就地交付: next()返回指向co_yield表达式中对象的指针, 在下一次next()之前有效, 不经过缓冲区拷贝.
+// 生产者中可以co_await其他异步操作(如sleep_ms), 此时消费者挂起等待.
+// 与Async相同, 生成器创建后停在起点, 第一次next()时开始执行, 由AsyncGenerator对象拥有协程帧.
+template <typename T> class AsyncGenerator {
+public:
+    struct promise_type {
+        const T *value = nullptr;          // 当前交付的值, 结束时为nullptr
+        std::coroutine_handle<> consumer;  // 等待下一个值的协程
+        bool resuming = false;             // 正在由next()同步恢复
+
+        static void *operator new(size_t size) { return frame_alloc(size); }
+        static void operator delete(void *p) { frame_free(p); }
+
+        AsyncGenerator get_return_object() {
+            return AsyncGenerator{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        // 交给消费者: 由next()同步恢复时直接挂起返回, 异步恢复时对称转移到消费者
+        struct YieldAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                auto &p = h.promise();
+                if (p.resuming || !p.consumer)
+                    return std::noop_coroutine();
+                return std::exchange(p.consumer, nullptr);
+            }
+            void await_resume() noexcept {}
+        };
+
+        YieldAwaiter yield_value(const T &v) noexcept {
+            value = &v;
+            return {};
+        }
+        YieldAwaiter final_suspend() noexcept {
+            value = nullptr;
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() {
+            printf("AsyncGenerator: [unhandled_exception]\n");
+        }
+    };
+
+    AsyncGenerator() = default;
+    explicit AsyncGenerator(std::coroutine_handle<promise_type> h) : _handle(h) {}
+    AsyncGenerator(AsyncGenerator &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+    AsyncGenerator &operator=(AsyncGenerator &&other) noexcept {
+        if (this != &other) {
+            reset();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+    ~AsyncGenerator() { reset(); }
+
+    void reset() {
+        if (_handle) {
+            _handle.destroy();
+            _handle = nullptr;
+        }
+    }
+    bool done() const { return !_handle || _handle.done(); }
+
+    // 取下一个值, 结束时返回nullptr
+    auto next() {
+        struct NextAwaiter {
+            AsyncGenerator *self;
+            bool await_ready() const { return self->done(); }
+            bool await_suspend(std::coroutine_handle<> awaiting) {
+                // 同步恢复生产者, 同步产生了值或结束时不挂起; 否则生产者产生值时恢复awaiting
+                auto &p = self->_handle.promise();
+                p.consumer = awaiting;
+                p.resuming = true;
+                self->_handle.resume();
+                p.resuming = false;
+                if (self->_handle.done() || p.value) {
+                    p.consumer = nullptr;
+                    return false;
+                }
+                return true;
+            }
+            const T *await_resume() {
+                if (self->done())
+                    return nullptr;
+                return std::exchange(self->_handle.promise().value, nullptr);
+            }
+        };
+        return NextAwaiter{this};
+    }
+
+    // 对每个值调用f, 相当于 for co_await (auto &v : gen) f(v);
+    template <typename F> Async<void> for_each(F f) {
+        while (const T *v = co_await next())
+            f(*v);
+    }
+
+private:
+    std::coroutine_handle<promise_type> _handle;
+};
+
+// 生成器 -> 流: 逐个发送到容量为size的流, 流满时生成器等待消费者取走数据, 生成器结束时关闭流
+template <typename T> Stream<T> stream_from(AsyncGenerator<T> gen, int size) {
+    auto pump = [](AsyncGenerator<T> gen, typename Stream<T>::Producer producer) -> Async<void> {
+        while (const T *v = co_await gen.next()) {
+            if (!co_await producer.send_async(*v))
+                co_return;
+        }
+        producer.finish();
+    };
+    auto holder = make_shared<AsyncGenerator<T>>(std::move(gen));
+    return Stream<T>(size, [pump, holder](typename Stream<T>::Producer producer) {
+        pump(std::move(*holder), producer).detach();
+    }, StreamPolicy::BLOCK);
+}
+
+// 等待流中有数据或流结束. 只持有裸指针, 由等待的协程保证流存活
+template <typename T> struct StreamReadyAwaiter {
+    typename Stream<T>::Consumer *c;
+    bool await_ready() const { return !c->buf.is_empty() || c->finished; }
+    void await_suspend(std::coroutine_handle<> h) {
+        auto c = this->c;
+        set_poll([c, h](Poll poll) {
+            if (!c->buf.is_empty() || c->finished) {
+                poll.remove();
+                h.resume();
+            } else {
+                c->waker.add(poll);
+                poll.park();
+            }
+        });
+    }
+    void await_resume() {}
+};
+
+// 流 -> 生成器: 值直接从流的缓冲区中交付, 消费者取下一个值时才弹出
+template <typename T> AsyncGenerator<T> generator_from(Stream<T> stream) {
+    auto c = stream.consumer();
+    while (true) {
+        while (!c->buf.is_empty()) {
+            co_yield c->buf.front();
+            c->pop();
+        }
+        if (c->finished)
+            co_return;
+        co_await StreamReadyAwaiter<T>{c.get()};
+    }
+}
+
+extern void _test_async_generator();
+
+#endif // __cplusplus >= 202002L
+
+#endif // ASYNC_GENERATOR_H
@@ -0,0 +1,204 @@
+#include "broadcast.h"
+
+#if __cplusplus >= 202002L
+
+#include <async.h>
+#include <timeout.h>
+#include <frame_pool.h>
+#include <assert.h>
+#include <test_counted.h>
+
+// 用next()读取全部数据, 每读一个后睡眠ms
+static Async<void> read_all(Broadcast<Counted>::Subscriber sub, u32 ms, int *sum, int *count, bool *ordered) {
+    int last = 0;
+    while (const Counted *f = co_await sub.next()) {
+        *ordered = *ordered && f->value == last + 1;
+        last = f->value;
+        *sum += f->value;
+        ++*count;
+        if (ms)
+            co_await sleep_ms(ms);
+    }
+}
+
+static Async<void> produce(Broadcast<Counted> b, int count, int *sent) {
+    for (int i = 1; i <= count; ++i) {
+        bool ok = co_await b.send_async(Counted(i));
+        assert(ok);
+        *sent = i;
+    }
+    b.finish();
+}
+
+// 发送左值: 复制一份存入等待者, 原对象不受影响
+static Async<void> produce_lvalue(Broadcast<Counted> b, const Counted *f, bool *ok) {
+    *ok = co_await b.send_async(*f);
+}
+
+void _test_broadcast() {
+    printf("Test Broadcast\n");
+    use_virtual_clock();
+    Counted::reset();
+    u32 rc_live = get_rc_stats().live;
+
+    // 每个订阅者都看到全部数据, 数据只存一份, 读取不复制
+    {
+        Broadcast<Counted> b(8);
+        int sum1 = 0, n1 = 0, sum2 = 0, n2 = 0;
+        bool ordered = true;
+        start_task_async([&](Task *) { return read_all(b.subscribe(), 0, &sum1, &n1, &ordered); });
+        start_task_async([&](Task *) { return read_all(b.subscribe(), 0, &sum2, &n2, &ordered); });
+        run_once();
+        assert(b.stats().subscribers == 2);
+        for (int i = 1; i <= 5; ++i)
+            assert(b.send(Counted(i)));
+        assert(Counted::live == 5 && b.stats().lag == 5);
+        run_for(10);
+        assert(n1 == 5 && n2 == 5 && sum1 == 15 && sum2 == 15 && ordered);
+        // 再次等待时释放上一个数据, 都读过后数据被释放
+        assert(Counted::live == 0 && Counted::copies == 0);
+        b.finish();
+        run_for(10);
+        assert(b.stats().subscribers == 0);
+    }
+
+    // 最慢的订阅者决定保留多少; 满时丢弃新数据
+    {
+        Broadcast<Counted> b(4);
+        auto fast = b.subscribe();
+        auto slow = b.subscribe();
+        for (int i = 1; i <= 4; ++i)
+            assert(b.send(Counted(i)));
+        assert(!b.send(Counted(5)));
+        while (!fast.is_empty())
+            fast.pop();
+        assert(Counted::live == 4 && fast.lag() == 0 && slow.lag() == 4);
+        assert(slow.front().value == 1);
+        slow.pop();
+        assert(Counted::live == 3 && b.send(Counted(6)));
+        BroadcastStats st = b.stats();
+        assert(st.sent == 5 && st.dropped == 1 && st.high_water == 4 && st.lag == 4);
+        // 退订释放它还没读的数据
+        { auto gone = std::move(slow); }
+        assert(Counted::live == 1 && fast.front().value == 6);
+        // 新订阅者只看到之后发送的数据
+        auto late = b.subscribe();
+        assert(late.is_empty() && b.send(Counted(7)) && late.front().value == 7 && fast.lag() == 2);
+    }
+    assert(Counted::live == 0);
+
+    // 覆盖旧数据: 最慢的订阅者跳过最旧的数据, 计入missed
+    {
+        Broadcast<Counted> b(3, StreamPolicy::OVERWRITE_OLDEST);
+        auto fast = b.subscribe();
+        auto slow = b.subscribe();
+        for (int i = 1; i <= 5; ++i) {
+            assert(b.send(Counted(i)));
+            fast.pop();
+        }
+        assert(slow.missed() == 2 && slow.front().value == 3 && fast.missed() == 0);
+        assert(b.stats().overwritten == 2 && Counted::live == 3);
+    }
+    // next()交出的数据在使用期间不会被覆盖, 新数据被丢弃
+    {
+        Broadcast<Counted> b(2, StreamPolicy::OVERWRITE_OLDEST);
+        int sum = 0, n = 0;
+        bool ordered = true;
+        start_task_async([&](Task *) { return read_all(b.subscribe(), 100, &sum, &n, &ordered); });
+        run_once();
+        b.send(Counted(1));
+        run_once();
+        assert(n == 1 && b.send(Counted(2)) && !b.send(Counted(3)));
+        assert(b.stats().dropped == 1 && b.stats().overwritten == 0);
+        b.finish();
+        run_for(300);
+        assert(n == 2 && sum == 3);
+    }
+
+    // 落后达到detach_lag的订阅者被断开, 其余订阅者不受影响
+    {
+        Broadcast<Counted> b(4, StreamPolicy::DROP_NEWEST, 3);
+        int sum = 0, n = 0;
+        bool ordered = true;
+        auto slow = b.subscribe();
+        start_task_async([&](Task *) { return read_all(b.subscribe(), 0, &sum, &n, &ordered); });
+        run_once();
+        for (int i = 1; i <= 10; ++i) {
+            assert(b.send(Counted(i)));
+            run_once();
+        }
+        assert(slow.is_detached() && slow.is_finished() && slow.is_empty());
+        assert(n == 10 && sum == 55 && ordered);
+        BroadcastStats st = b.stats();
+        assert(st.detached == 1 && st.subscribers == 1 && st.dropped == 0);
+        b.print_stats("detach");
+        b.finish();
+        run_once();
+    }
+    assert(Counted::live == 0);
+
+    // 阻塞: 生产者等待最慢的订阅者, 不丢数据
+    {
+        Broadcast<Counted> b(4, StreamPolicy::BLOCK);
+        int sent = 0, sum1 = 0, n1 = 0, sum2 = 0, n2 = 0;
+        bool ordered = true;
+        start_task_async([&](Task *) { return read_all(b.subscribe(), 1, &sum1, &n1, &ordered); });
+        start_task_async([&](Task *) { return read_all(b.subscribe(), 10, &sum2, &n2, &ordered); });
+        run_once();
+        start_task_async([&](Task *) { return produce(b, 20, &sent); });
+        run_for(5);
+        assert(sent <= 5);
+        run_for(1000);
+        BroadcastStats st = b.stats();
+        assert(sent == 20 && n1 == 20 && n2 == 20 && sum1 == 210 && sum2 == 210 && ordered);
+        assert(st.dropped == 0 && st.sent == 20 && st.high_water == 4 && Counted::copies == 0);
+        b.print_stats("block");
+    }
+    run_once();
+
+    // 阻塞时send计入blocked而不是dropped; send_async可以发送左值, 等待期间数据保存在等待者中
+    {
+        Broadcast<Counted> b(1, StreamPolicy::BLOCK);
+        auto sub = b.subscribe();
+        assert(b.send(Counted(1)) && !b.send(Counted(2)));
+        assert(b.stats().blocked == 1 && b.stats().dropped == 0);
+        Counted f(3);
+        bool ok = false;
+        start_task_async([&](Task *) { return produce_lvalue(b, &f, &ok); });
+        run_once();
+        assert(!ok && Counted::copies == 1 && f.value == 3);
+        sub.pop();
+        run_once();
+        assert(ok && sub.front().value == 3 && Counted::live == 2);
+    }
+    assert(Counted::live == 0);
+    Counted::reset();
+    run_once();
+
+    // 回调订阅: 流结束后退订
+    {
+        Broadcast<Counted> b(4);
+        int sum = 0;
+        b.subscribe([&sum](Broadcast<Counted>::Subscriber &sub) {
+            while (!sub.is_empty()) {
+                sum += sub.front().value;
+                sub.pop();
+            }
+        });
+        run_once();
+        b.send(Counted(1));
+        b.send(Counted(2));
+        run_once();
+        b.send(Counted(3));
+        b.finish();
+        run_once();
+        assert(sum == 6 && b.stats().subscribers == 0);
+    }
+    run_once();
+    assert(Counted::live == 0);
+    assert(get_frame_stats().live == 0 && get_rc_stats().live == rc_live);
+    use_system_clock();
+    printf("Test Broadcast PASS\n");
+}
+
+#endif // __cplusplus >= 202002L
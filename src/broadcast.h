@@ -0,0 +1,304 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <poll.h>
+#include <rc.h>
+#include <stream.h>
+#include <stdio.h>
+
+#if __cplusplus >= 202002L
+#include <coroutine>
+#endif
+
+// 广播流: 所有订阅者共享一个环形缓冲区, 每个订阅者有自己的读位置, 都能看到订阅之后发送的每个数据.
+// 数据只存一份, 订阅者读取时直接引用缓冲区中的数据, 不复制; 最慢的订阅者读过之后数据才被释放.
+// 缓冲区满时先断开落后达到detach_lag的订阅者(0表示不断开), 仍然满时按StreamPolicy处理:
+//   DROP_NEWEST       丢弃新数据
+//   OVERWRITE_OLDEST  最慢的订阅者跳过最旧的数据, 计入它的missed
+//   BLOCK             send失败, 生产者等到有空间再发送
+// Broadcast是句柄, 复制后指向同一个流. 只能在轮询循环中使用.
+struct BroadcastStats {
+    u32 sent;        // 进入缓冲区的数据数
+    u32 dropped;     // 缓冲区满时丢弃的新数据数
+    u32 blocked;     // BLOCK策略下缓冲区满时拒绝的发送数, 数据留在生产者手中, 不算丢弃
+    u32 overwritten; // 被覆盖的旧数据数
+    u32 detached;    // 因落后太多被断开的订阅者数
+    u32 high_water;  // 缓冲区中数据数的最高水位
+    u32 lag;         // 最慢的订阅者还未读取的数据数
+    u32 subscribers; // 当前订阅者数
+};
+
+template <typename T> class Broadcast {
+public:
+    // 订阅者的读位置
+    struct Cursor {
+        u64 pos;              // 下一个要读的序号
+        u32 missed = 0;       // 被覆盖而错过的数据数
+        bool detached = false;
+        bool holding = false; // next()交出的数据还在使用, 不能被覆盖
+        Waker waker;
+        explicit Cursor(u64 pos) : pos(pos) {}
+    };
+
+    struct State {
+        struct Slot {
+            alignas(T) unsigned char mem[sizeof(T)];
+        };
+        Unique<Slot[]> slots;
+        u32 capacity;
+        u64 head = 0; // 下一个写入的序号
+        u64 tail = 0; // 最旧的保留数据的序号
+        bool finished = false;
+        StreamPolicy policy;
+        u32 detach_lag;
+        Vec<Cursor *> subs;
+        Waker space; // 等待空间的生产者
+        BroadcastStats counters = {};
+
+        State(u32 cap, StreamPolicy policy, u32 detach_lag)
+            : slots(new Slot[cap]), capacity(cap), policy(policy), detach_lag(detach_lag) {}
+        ~State() {
+            for (u64 seq = tail; seq != head; ++seq)
+                at(seq)->~T();
+        }
+        T *at(u64 seq) { return std::launder(reinterpret_cast<T *>(slots[seq % capacity].mem)); }
+        bool is_full() const { return head - tail == capacity; }
+
+        // 释放所有订阅者都已读过的数据
+        void trim() {
+            u64 min = head;
+            for (auto c : subs)
+                if (c->pos < min)
+                    min = c->pos;
+            if (min == tail)
+                return;
+            for (; tail != min; ++tail)
+                at(tail)->~T();
+            space.wake();
+        }
+        void remove(Cursor *c) {
+            for (u32 i = 0; i < subs.size(); ++i) {
+                if (subs[i] == c) {
+                    subs[i] = subs.back();
+                    subs.pop_back();
+                    break;
+                }
+            }
+        }
+        // 缓冲区满时腾出空间, 腾不出时返回false
+        bool make_room() {
+            if (detach_lag) {
+                // 正在使用数据的订阅者等它释放后再断开, 它拿到的指针不会失效
+                for (u32 i = 0; i < subs.size();) {
+                    Cursor *c = subs[i];
+                    if (head - c->pos >= detach_lag && !c->holding) {
+                        counters.detached++;
+                        c->detached = true;
+                        c->waker.wake();
+                        subs[i] = subs.back();
+                        subs.pop_back();
+                    } else {
+                        ++i;
+                    }
+                }
+                trim();
+                if (!is_full())
+                    return true;
+            }
+            if (policy != StreamPolicy::OVERWRITE_OLDEST)
+                return false;
+            // 正在使用最旧数据的订阅者不能跳过
+            for (auto c : subs)
+                if (c->pos == tail && c->holding)
+                    return false;
+            for (auto c : subs) {
+                if (c->pos == tail) {
+                    c->pos++;
+                    c->missed++;
+                }
+            }
+            counters.overwritten++;
+            trim();
+            return true;
+        }
+        template <typename U> bool push(U &&value) {
+            if (finished)
+                return false;
+            if (is_full() && !make_room()) {
+                if (policy == StreamPolicy::BLOCK)
+                    counters.blocked++;
+                else
+                    counters.dropped++;
+                return false;
+            }
+            counters.sent++;
+            if (subs.empty())
+                return true; // 没有订阅者, 不保留
+            new (slots[head % capacity].mem) T(std::forward<U>(value));
+            head++;
+            if (head - tail > counters.high_water)
+                counters.high_water = head - tail;
+            for (auto c : subs)
+                c->waker.wake();
+            return true;
+        }
+        void finish() {
+            finished = true;
+            for (auto c : subs)
+                c->waker.wake();
+            space.wake();
+        }
+        bool is_writable() const { return finished || !is_full(); }
+    };
+
+    // 订阅者: 仅可移动, 析构时退订, 它还未读的数据随之释放
+    class Subscriber {
+        Rc<State> _s;
+        Unique<Cursor> _c;
+
+    public:
+        Subscriber(const Rc<State> &s) : _s(s), _c(make_unique<Cursor>(s->head)) { s->subs.push_back(_c.get()); }
+        Subscriber(Subscriber &&) noexcept = default;
+        ~Subscriber() {
+            if (_c && !_c->detached) {
+                _s->remove(_c.get());
+                _s->trim();
+            }
+        }
+
+        bool is_empty() const { return _c->detached || _c->pos == _s->head; }
+        // 队首数据的引用, 在pop之前有效
+        const T &front() const {
+            assert(!is_empty());
+            return *_s->at(_c->pos);
+        }
+        void pop() {
+            if (is_empty())
+                return;
+            _c->pos++;
+            _c->holding = false;
+            _s->trim();
+        }
+        // 流已结束且已读完, 或已被断开
+        bool is_finished() const { return _c->detached || (_s->finished && _c->pos == _s->head); }
+        bool is_detached() const { return _c->detached; }
+        u32 lag() const { return _c->detached ? 0 : (u32)(_s->head - _c->pos); }
+        u32 missed() const { return _c->missed; }
+        Cursor *cursor() const { return _c.get(); }
+        State *state() const { return _s.get(); }
+
+#if __cplusplus >= 202002L
+        // const T *v = co_await sub.next(); 释放上一次交出的数据, 等待下一个.
+        // 返回的指针在下一次next()或pop()之前有效, 流结束或订阅者被断开时返回nullptr
+        struct NextAwaiter {
+            Subscriber *sub;
+            bool await_ready() const {
+                auto c = sub->_c.get();
+                if (c->holding)
+                    sub->pop();
+                return !sub->is_empty() || sub->is_finished();
+            }
+            void await_suspend(std::coroutine_handle<> h) const {
+                Poll p = set_poll([sub = sub, h](Poll p) {
+                    if (!sub->is_empty() || sub->is_finished()) {
+                        p.remove();
+                        h.resume();
+                    } else {
+                        sub->_c->waker.add(p);
+                        p.park();
+                    }
+                });
+                p.park();
+                sub->_c->waker.add(p);
+            }
+            const T *await_resume() const {
+                if (sub->is_empty())
+                    return nullptr;
+                sub->_c->holding = true;
+                return &sub->front();
+            }
+        };
+        NextAwaiter next() { return {this}; }
+#endif
+    };
+
+    explicit Broadcast(u32 capacity, StreamPolicy policy = StreamPolicy::DROP_NEWEST, u32 detach_lag = 0)
+        : _s(make_rc<State>(capacity, policy, detach_lag)) {
+        assert(capacity > 0);
+    }
+
+    // 订阅: 从下一个发送的数据开始接收
+    Subscriber subscribe() const { return Subscriber(_s); }
+    // 回调方式订阅: 有数据时调用cb(sub), cb中用front/pop读取; 流结束或订阅者被断开后退订
+    Poll subscribe(const Func<void(Subscriber &)> &cb) const {
+        return set_poll([sub = subscribe(), cb](Poll p) mutable {
+            if (!sub.is_empty())
+                cb(sub);
+            if (sub.is_finished()) {
+                p.remove();
+            } else if (sub.is_empty()) {
+                sub.cursor()->waker.add(p);
+                p.park();
+            }
+        });
+    }
+
+    // 按策略发送, 数据被丢弃或流已结束时返回false
+    bool send(const T &value) const { return _s->push(value); }
+    bool send(T &&value) const { return _s->push(std::move(value)); }
+    void finish() const { _s->finish(); }
+    bool is_writable() const { return _s->is_writable(); }
+    // 有空间(或流已结束)时调用cb, 已经可写时立即调用
+    void on_space(PollFunc cb) const {
+        if (_s->is_writable()) {
+            cb();
+            return;
+        }
+        Poll node = set_poll([s = _s, cb = std::move(cb)](Poll poll) {
+            if (!s->is_writable()) {
+                s->space.add(poll);
+                poll.park();
+                return;
+            }
+            poll.remove();
+            cb();
+        });
+        node.park();
+        _s->space.add(node);
+    }
+
+#if __cplusplus >= 202002L
+    // co_await b.send_async(v): 等到有空间再发送, 流已结束返回false. 数据按值保存在等待者中, 发送时移动进缓冲区
+    struct SendAwaiter {
+        const Broadcast *b;
+        T value;
+        bool await_ready() const { return b->is_writable(); }
+        void await_suspend(std::coroutine_handle<> h) const { b->on_space([h] { h.resume(); }); }
+        bool await_resume() { return b->send(std::move(value)); }
+    };
+    SendAwaiter send_async(T value) const { return {this, std::move(value)}; }
+#endif
+
+    BroadcastStats stats() const {
+        BroadcastStats st = _s->counters;
+        st.subscribers = _s->subs.size();
+        st.lag = (u32)(_s->head - _s->tail);
+        return st;
+    }
+    void print_stats(const char *name) const {
+        BroadcastStats st = stats();
+        printf("%s: sent %u, dropped %u, blocked %u, overwritten %u, detached %u, high water %u/%u, lag %u, "
+               "subscribers %u\n",
+               name, (unsigned)st.sent, (unsigned)st.dropped, (unsigned)st.blocked, (unsigned)st.overwritten,
+               (unsigned)st.detached, (unsigned)st.high_water, (unsigned)_s->capacity, (unsigned)st.lag,
+               (unsigned)st.subscribers);
+    }
+    State *state() const { return _s.get(); }
+
+private:
+    Rc<State> _s;
+};
+
+extern void _test_broadcast();
+
+#endif // BROADCAST_H
@@ -94,6 +94,14 @@ template <typename T> class Buf {
         _head = next;
         return true;
     }
+    inline bool push(T &&v) {
+        int next = (_head + 1) % _buf_size;
+        if (next == _tail)
+            return false; // 满
+        _buf[_head] = static_cast<T &&>(v);
+        _head = next;
+        return true;
+    }
     inline int push(const T *many, int n) {
         for (int i = 0; i < n; i++) {
             if (!push(many[i]))
@@ -0,0 +1,125 @@
+#include <channel.h>
+#include <stdio.h>
+#include <assert.h>
+
+#if __cplusplus >= 202002L
+
+static Async<void> produce(Channel<int> ch, int count, int *sent) {
+    for (int i = 1; i <= count; ++i) {
+        bool ok = co_await ch.send(i);
+        assert(ok);
+        *sent = i;
+    }
+    ch.close();
+}
+
+static Async<void> consume_slowly(Channel<int> ch, int *sum) {
+    while (true) {
+        co_await sleep_ms(10);
+        Optional<int> v = co_await ch.recv();
+        if (!v)
+            break;
+        *sum += *v;
+    }
+}
+
+static Async<void> move_only(Channel<Unique<int>> ch, int *sum) {
+    auto p = make_unique<int>(5);
+    co_await ch.send(std::move(p));
+    co_await ch.send(make_unique<int>(6));
+    for (int i = 0; i < 2; ++i) {
+        Optional<Unique<int>> v = co_await ch.recv();
+        *sum += **v;
+    }
+}
+
+static Async<void> recv_one(Channel<int> ch, int id, Vec<int> *got) {
+    Optional<int> v = co_await ch.recv();
+    got->push_back(id * 10 + *v);
+}
+
+struct SelectCase {
+    int from_a = 0, from_b = 0, timeouts = 0;
+    bool done = false;
+};
+
+static Async<void> select_loop(Channel<int> a, Channel<int> b, SelectCase *c) {
+    while (true) {
+        Optional<int> va, vb;
+        size_t i = co_await select(recv_case(a, va), recv_case(b, vb), timeout_case(30));
+        if (i == 0) {
+            if (!va)
+                break;
+            c->from_a += *va;
+        } else if (i == 1) {
+            c->from_b += *vb;
+        } else {
+            c->timeouts++;
+        }
+    }
+    c->done = true;
+}
+
+void _test_channel() {
+    printf("Test Channel\n");
+    use_virtual_clock();
+
+    // 背压: 容量为2, 生产者在满时挂起, 消费者每10ms取一个
+    Channel<int> ch(2);
+    int sent = 0, sum = 0;
+    start_task_async([&](Task *) { return produce(ch, 10, &sent); });
+    start_task_async([&](Task *) { return consume_slowly(ch, &sum); });
+    run_for(5);
+    assert(sent == 2 && ch.size() == 2);
+    run_for(10);
+    assert(sent == 3 && sum == 1);
+    run_for(1000);
+    assert(sent == 10 && sum == 55 && ch.is_closed());
+    assert(!ch.try_send(1) && !ch.try_recv());
+
+    // 被唤醒后数据已被抢走的接收者排回队首, 下一个数据仍先交给它; 重新排队不计入获取
+    Channel<int> order_ch(1);
+    Vec<int> got;
+    start_task_async([&](Task *) { return recv_one(order_ch, 1, &got); });
+    start_task_async([&](Task *) { return recv_one(order_ch, 2, &got); });
+    run_once();
+    WaitQueue &rq = order_ch.state()->recv_waiters;
+    u32 contended = rq.stats().contended;
+    assert(contended == 2 && rq.stats().waiting == 2);
+    order_ch.try_send(7);
+    assert(order_ch.try_recv() == 7);
+    run_once();
+    assert(got.empty() && rq.stats().waiting == 2 && rq.stats().contended == contended);
+    assert(order_ch.try_send(1));
+    run_once();
+    assert(got.size() == 1 && got[0] == 11);
+    assert(order_ch.try_send(2));
+    run_once();
+    assert(got.size() == 2 && got[0] == 11 && got[1] == 22);
+
+    // 仅移动的类型
+    Channel<Unique<int>> uch(2);
+    int usum = 0;
+    start_task_async([&](Task *) { return move_only(uch, &usum); });
+    run_for(10);
+    assert(usum == 11);
+
+    // select: 数据到达时取数据, 没有数据时超时; 失效的登记不会在通道队列中累积
+    Channel<int> a(4), b(4);
+    SelectCase c;
+    start_task_async([&](Task *) { return select_loop(a, b, &c); });
+    set_timeout(10, [a]() mutable { a.try_send(1); });
+    set_timeout(20, [b]() mutable { b.try_send(2); });
+    set_timeout(1000, [a]() mutable { a.try_send(3); });
+    set_timeout(2000, [a]() mutable { a.close(); });
+    run_until([&c] { return c.done; });
+    assert(c.from_a == 4 && c.from_b == 2);
+    assert(c.timeouts > 50);
+    assert(b.state()->recv_waiters.stats().waiting <= 16);
+    run_once();
+    assert(get_frame_stats().live == 0);
+    use_system_clock();
+    printf("Test Channel PASS\n");
+}
+
+#endif // __cplusplus >= 202002L
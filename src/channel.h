@@ -0,0 +1,294 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#if __cplusplus >= 202002L
+
+#include <async.h>
+#include <sync.h>
+#include <timeout.h>
+#include <tuple>
+
+// 有界通道: 容量在创建时固定, 数据存放在预先分配的环形缓冲区中, 收发不分配内存, 支持仅移动的类型.
+//   co_await ch.send(v)   满时挂起, 通道已关闭返回false
+//   co_await ch.recv()    空时挂起, 返回Optional<T>, 通道关闭且已取完时为空
+// 等待者是挂起的节点, 被唤醒后重新检查, 不占用轮询. Channel是句柄, 复制后指向同一个通道.
+template <typename T> class Channel {
+public:
+    struct State {
+        struct Slot {
+            alignas(T) unsigned char mem[sizeof(T)];
+        };
+        Unique<Slot[]> slots;
+        u32 capacity;
+        u32 head = 0;
+        u32 count = 0;
+        bool closed = false;
+        WaitQueue recv_waiters{SYNC_CHANNEL};
+        WaitQueue send_waiters{SYNC_CHANNEL};
+
+        explicit State(u32 cap) : slots(new Slot[cap]), capacity(cap) {}
+        ~State() {
+            while (count > 0)
+                take();
+        }
+        T *at(u32 i) { return std::launder(reinterpret_cast<T *>(slots[i].mem)); }
+        bool can_send() const { return closed || count < capacity; }
+        bool can_recv() const { return closed || count > 0; }
+
+        template <typename U> void put(U &&value) {
+            u32 tail = head + count;
+            if (tail >= capacity)
+                tail -= capacity;
+            new (slots[tail].mem) T(std::forward<U>(value));
+            count++;
+            recv_waiters.count_acquire();
+            recv_waiters.wake_one();
+        }
+        T take() {
+            T *p = at(head);
+            T value = std::move(*p);
+            p->~T();
+            if (++head == capacity)
+                head = 0;
+            count--;
+            send_waiters.count_acquire();
+            send_waiters.wake_one();
+            return value;
+        }
+        // 在q上挂起等待ready()成立后恢复h, 被唤醒时条件不成立(被其他人抢先)则排回队首
+        template <typename Ready> static void wait(WaitQueue &q, Ready ready, std::coroutine_handle<> h) {
+            Poll p = set_poll([&q, ready, h](Poll p) {
+                if (ready()) {
+                    p.remove();
+                    h.resume();
+                } else {
+                    q.requeue(p);
+                    p.park();
+                }
+            });
+            p.park();
+            q.push(p);
+        }
+    };
+
+    explicit Channel(u32 capacity) : _s(make_shared<State>(capacity)) { assert(capacity > 0); }
+
+    bool try_send(T &&value) {
+        if (_s->closed || _s->count == _s->capacity)
+            return false;
+        _s->put(std::move(value));
+        return true;
+    }
+    bool try_send(const T &value) {
+        if (_s->closed || _s->count == _s->capacity)
+            return false;
+        _s->put(value);
+        return true;
+    }
+    Optional<T> try_recv() {
+        if (_s->count == 0)
+            return {};
+        return _s->take();
+    }
+    // 关闭: 之后的发送失败, 接收取完剩余数据后返回空, 所有等待者被唤醒
+    void close() {
+        _s->closed = true;
+        _s->recv_waiters.wake_all();
+        _s->send_waiters.wake_all();
+    }
+    bool is_closed() const { return _s->closed; }
+    u32 size() const { return _s->count; }
+    u32 capacity() const { return _s->capacity; }
+    State *state() const { return _s.get(); }
+
+    // 等待者被唤醒后在await_resume中完成收发, 唤醒与恢复之间没有其他回调插入
+    template <typename P> struct SendAwaiter {
+        State *s;
+        P value; // T* 或 const T*, 指向的对象在整个co_await表达式期间有效
+        bool await_ready() const { return s->can_send(); }
+        void await_suspend(std::coroutine_handle<> h) {
+            auto s = this->s;
+            State::wait(s->send_waiters, [s] { return s->can_send(); }, h);
+        }
+        bool await_resume() {
+            if (s->closed)
+                return false;
+            if constexpr (std::is_const_v<std::remove_pointer_t<P>>)
+                s->put(*value);
+            else
+                s->put(std::move(*value));
+            return true;
+        }
+    };
+    SendAwaiter<T *> send(T &&value) { return {_s.get(), &value}; }
+    SendAwaiter<const T *> send(const T &value) { return {_s.get(), &value}; }
+
+    struct RecvAwaiter {
+        State *s;
+        bool await_ready() const { return s->can_recv(); }
+        void await_suspend(std::coroutine_handle<> h) {
+            auto s = this->s;
+            State::wait(s->recv_waiters, [s] { return s->can_recv(); }, h);
+        }
+        Optional<T> await_resume() {
+            if (s->count == 0)
+                return {};
+            return s->take();
+        }
+    };
+    RecvAwaiter recv() { return {_s.get()}; }
+
+private:
+    Shared<State> _s;
+};
+
+// select的分支, 每个分支提供:
+//   bool try_fire()   不挂起地尝试完成, 完成返回true
+//   void arm(Poll p)  登记等待节点, 可能就绪时唤醒p, 可能被调用多次(被唤醒后条件不成立时排回队首)
+//   void disarm()     select结束, 撤销自己登记的定时器等
+//   void pass_on()    select结束, 把可能被本select吞掉的唤醒转给同一队列中的下一个等待者
+
+// 接收: 收到的数据写入out, 通道关闭且已取完时也算完成, out为空
+template <typename T> struct RecvCase {
+    typename Channel<T>::State *s;
+    Optional<T> *out;
+    bool try_fire() {
+        if (s->count > 0) {
+            *out = s->take();
+            return true;
+        }
+        if (s->closed) {
+            out->reset();
+            return true;
+        }
+        return false;
+    }
+    bool queued = false;
+    void arm(Poll p) {
+        if (queued)
+            s->recv_waiters.requeue(p);
+        else
+            s->recv_waiters.push(p);
+        queued = true;
+    }
+    void disarm() {}
+    void pass_on() {
+        if (s->can_recv())
+            s->recv_waiters.wake_one();
+    }
+};
+
+// 发送: 有空间时移动value进入通道; 通道已关闭时也算完成, 用ch.is_closed()区分
+template <typename T> struct SendCase {
+    typename Channel<T>::State *s;
+    T *value;
+    bool try_fire() {
+        if (s->closed)
+            return true;
+        if (s->count == s->capacity)
+            return false;
+        s->put(std::move(*value));
+        return true;
+    }
+    bool queued = false;
+    void arm(Poll p) {
+        if (queued)
+            s->send_waiters.requeue(p);
+        else
+            s->send_waiters.push(p);
+        queued = true;
+    }
+    void disarm() {}
+    void pass_on() {
+        if (s->can_send())
+            s->send_waiters.wake_one();
+    }
+};
+
+// 超时: 第一次arm时启动定时器
+struct TimeoutCase {
+    u32 ms;
+    Timeout timer;
+    bool fired = false;
+    explicit TimeoutCase(u32 ms) : ms(ms) {}
+    bool try_fire() { return fired; }
+    void arm(Poll p) {
+        if (timer.is_null())
+            timer = set_timeout(ms, [this, p] {
+                fired = true;
+                p.wake();
+            });
+    }
+    void disarm() { timer.stop(); }
+    void pass_on() {}
+};
+
+template <typename T> RecvCase<T> recv_case(const Channel<T> &ch, Optional<T> &out) {
+    return {ch.state(), &out};
+}
+template <typename T> SendCase<T> send_case(const Channel<T> &ch, T &value) {
+    return {ch.state(), &value};
+}
+inline TimeoutCase timeout_case(u32 ms) {
+    return TimeoutCase(ms);
+}
+
+template <typename... Cases> struct _Select {
+    std::tuple<Cases &...> cases;
+    size_t fired = 0;
+    Poll node;
+    bool waited = false; // 挂起等待过, 可能吞掉了其他分支的唤醒
+
+    explicit _Select(Cases &...c) : cases(c...) {}
+
+    // 按参数顺序尝试, 先列出的分支优先
+    bool try_fire() { return try_fire(std::index_sequence_for<Cases...>{}); }
+    template <size_t... I> bool try_fire(std::index_sequence<I...>) {
+        return ((std::get<I>(cases).try_fire() ? (fired = I, true) : false) || ...);
+    }
+    void arm(Poll p) {
+        std::apply([p](auto &...c) { (c.arm(p), ...); }, cases);
+    }
+    void finish() {
+        node.remove();
+        std::apply([](auto &...c) { (c.disarm(), ...); }, cases);
+        if (waited)
+            std::apply([](auto &...c) { (c.pass_on(), ...); }, cases);
+    }
+    ~_Select() { finish(); }
+};
+
+template <typename S> struct _SelectAwaiter {
+    S *sel;
+    bool await_ready() const { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        auto sel = this->sel;
+        sel->waited = true;
+        sel->node = set_poll([sel, h](Poll p) {
+            if (sel->try_fire()) {
+                h.resume();
+            } else {
+                sel->arm(p);
+                p.park();
+            }
+        });
+        sel->arm(sel->node);
+        sel->node.park();
+    }
+    void await_resume() {}
+};
+
+// 同时等待多个通道收发和定时器, 返回最先完成的分支下标; 多个分支同时就绪时取靠前的一个
+//   size_t i = co_await select(recv_case(a, va), send_case(b, x), timeout_case(50));
+template <typename... Cases> Async<size_t> select(Cases... cases) {
+    _Select<Cases...> sel(cases...);
+    if (!sel.try_fire())
+        co_await _SelectAwaiter<_Select<Cases...>>{&sel};
+    co_return sel.fired;
+}
+
+extern void _test_channel();
+
+#endif // __cplusplus >= 202002L
+
+#endif // CHANNEL_H
@@ -13,6 +13,9 @@
 extern void cmd_ps(Env env);
 extern void cmd_kill(Env env);
 extern void cmd_killall(Env env);
+extern void cmd_idle(Env env);
+extern void cmd_frames(Env env);
+extern void cmd_sync(Env env);
 
 static u32 _total_mem = 0;
 
@@ -49,6 +52,7 @@ static u32 calc_mem_free() {
 void cmd_free(Env e) {
     u32 free_ = calc_mem_free();
     e.io().printf("free: %u bytes(%d%%), total: %u bytes\n", (unsigned)free_, int(free_*100/_total_mem), (unsigned)_total_mem);
+    e.io().printf("inplace func heap allocs: %u\n", (unsigned)inplace_func_heap_count());
     e.exit(0);
 }
 
@@ -82,6 +86,9 @@ static const CommandEntry _builtin_cmd_table[] = {
     {"killall", cmd_killall, "Kill all threads"},
     {"free", cmd_free, "Show free heap size"},
     {"pref", cmd_pref, "Show poll frequency"},
+    {"idle", cmd_idle, "Show idle/busy time"},
+    {"frames", cmd_frames, "Show coroutine frame pool stats"},
+    {"sync", cmd_sync, "Show mutex/semaphore/event/condvar contention"},
     {"test_promise", cmd_test_promise, "Test promise"},
     {"test_async", cmd_test_async, "Test async"},
     {nullptr, nullptr, nullptr} // 结束标志
@@ -139,13 +146,18 @@ void Console::init() {
     _cursor_pos = 0;
     _escape_state = 0;
     _escape_len = 0;
-    set_poll([this] {
+    set_poll([this](Poll p) {
         if (_cmd_thread) {
             if(_cmd_thread->is_running()) {
                 // 如果命令线程正在运行, 则不处理输入只接受ctrl_c
                 int res = _buf->getc();
                 if (res == 0x3) { // ctrl-c
                     _cmd_thread->terminal();
+                } else if (res == -1) {
+                    // 挂起, 等待输入或命令线程结束
+                    _buf->wait_rx(p);
+                    _cmd_thread->wait_exit(p);
+                    p.park();
                 }
             } else {
                 // 线程已经停止, 准备下一个命令行
@@ -161,7 +173,12 @@ void Console::init() {
         } else {
             // 接收字符
             int c = _buf->getc();
-            if (c == -1) return; // 无字符输入
+            if (c == -1) {
+                // 无字符输入, 挂起等待
+                _buf->wait_rx(p);
+                p.park();
+                return;
+            }
             //printf("%x\n", c);
             
             if (_escape_state > 0) {
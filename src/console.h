@@ -39,7 +39,7 @@ struct CommandFunc {
         }
 #if __cplusplus >= 202002L
         else if (_async_cmd) {
-            _async_cmd(env);
+            _async_cmd(env).detach();
         }
 #endif
         else {
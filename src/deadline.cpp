@@ -0,0 +1,90 @@
+#include <deadline.h>
+#include <stdio.h>
+#include <assert.h>
+
+#if __cplusplus >= 202002L
+
+static Promise<int> resolve_after(u32 ms, int value) {
+    return Promise<int>([=](auto resolve) { set_timeout(ms, [=] { resolve(value); }); });
+}
+
+static Async<int> slow_add(int x, u32 ms) {
+    co_await sleep_ms(ms);
+    co_return x + 1;
+}
+
+// 仅移动, 没有默认构造
+struct Token {
+    int id;
+    explicit Token(int id) : id(id) {}
+    Token(Token &&) = default;
+    Token &operator=(Token &&) = default;
+    Token(const Token &) = delete;
+};
+
+static Async<void> await_token(Promise<Token> p, u32 ms, Timed<Token> *out) {
+    *out = co_await with_timeout(std::move(p), ms);
+}
+
+struct DeadlineCase {
+    Timed<int> promise_ok, promise_late, async_ok, async_late;
+    Timed<void> sleep_ok, sleep_late;
+    Timed<int> stream_values[4];
+    bool done = false;
+};
+
+static Async<void> deadline_driver(DeadlineCase *c) {
+    c->promise_ok = co_await with_timeout(resolve_after(10, 7), 50);
+    c->promise_late = co_await with_timeout(resolve_after(100, 8), 50);
+    c->async_ok = co_await with_timeout(slow_add(1, 10), 50);
+    c->async_late = co_await with_timeout(slow_add(2, 100), 50);
+    c->sleep_ok = co_await with_timeout(sleep_ms(10), 50);
+    c->sleep_late = co_await with_timeout(sleep_ms(100), 50);
+    // 流: 前两个数据及时到达, 之后停顿超时, 最后结束
+    Stream<int> stream(4, [](Stream<int>::Producer producer) {
+        set_timeout(10, [producer] { producer.send(1); });
+        set_timeout(20, [producer] { producer.send(2); });
+        set_timeout(100, [producer] { producer.finish(); });
+    });
+    for (auto &v : c->stream_values)
+        v = co_await with_timeout(stream, 50);
+    c->done = true;
+}
+
+void _test_deadline() {
+    printf("Test Deadline\n");
+    use_virtual_clock();
+    DeadlineCase c;
+    start_task_async([&c](Task *) { return deadline_driver(&c); });
+    run_until([&c] { return c.done; });
+    assert(c.promise_ok && *c.promise_ok == 7);
+    assert(c.promise_late.timed_out());
+    assert(c.async_ok && *c.async_ok == 2);
+    assert(c.async_late.timed_out());
+    assert(c.sleep_ok && c.sleep_late.timed_out());
+    assert(*c.stream_values[0] == 1 && *c.stream_values[1] == 2);
+    assert(c.stream_values[2].timed_out());
+    assert(c.stream_values[3].status == WaitStatus::CLOSED);
+
+    // 仅移动, 不可默认构造的结果从Promise中移动出来; 超时时没有值
+    Timed<Token> token{WaitStatus::CLOSED}, late{WaitStatus::CLOSED};
+    start_task_async([&token](Task *) {
+        return await_token(Promise<Token>([](auto r) { set_timeout(10, [r] { r(Token(5)); }); }), 50, &token);
+    });
+    start_task_async([&late](Task *) {
+        return await_token(Promise<Token>([](auto r) { set_timeout(100, [r] { r(Token(6)); }); }), 50, &late);
+    });
+    run_for(200);
+    assert(token.ok() && token->id == 5);
+    assert(late.timed_out() && !late.value);
+
+    // 先完成的一方已删除另一方, 超时的子协程随任务删除; 驱动任务退出后循环中不再有回调
+    run_once();
+    RunResult r = run_for(1000);
+    assert(r.work == 0);
+    assert(get_frame_stats().live == 0);
+    use_system_clock();
+    printf("Test Deadline PASS\n");
+}
+
+#endif // __cplusplus >= 202002L
@@ -0,0 +1,226 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#if __cplusplus >= 202002L
+
+#include <async.h>
+#include <promise.h>
+#include <stream.h>
+
+// 带期限的等待: co_await with_timeout(x, ms), x可以是Promise, Stream, Async, sleep_ms/sleep_us.
+// 等待期间只有一个挂起的等待节点和一个定时器, 先完成的一方立即删除另一方, 循环中不留下过期的节点.
+enum class WaitStatus {
+    OK,      // 等到了结果
+    TIMEOUT, // 超时, 等待的操作已取消
+    CLOSED,  // 流已结束没有更多数据, 或Promise被reject
+};
+
+// 等到结果时value有值, 用*r或r->取值; 结果不要求可默认构造, 仅移动的类型也可以
+template <typename T> struct Timed {
+    WaitStatus status = WaitStatus::OK;
+    Optional<T> value = {};
+    bool ok() const { return status == WaitStatus::OK; }
+    bool timed_out() const { return status == WaitStatus::TIMEOUT; }
+    explicit operator bool() const { return ok(); }
+    T &operator*() & {
+        assert(ok());
+        return *value;
+    }
+    const T &operator*() const & {
+        assert(ok());
+        return *value;
+    }
+    T &&operator*() && {
+        assert(ok());
+        return std::move(*value);
+    }
+    T *operator->() {
+        assert(ok());
+        return &*value;
+    }
+};
+template <> struct Timed<void> {
+    WaitStatus status = WaitStatus::OK;
+    bool ok() const { return status == WaitStatus::OK; }
+    bool timed_out() const { return status == WaitStatus::TIMEOUT; }
+    explicit operator bool() const { return ok(); }
+};
+
+// 事件源适配, 特化后即可用于with_timeout:
+//   bool ready()          事件已发生
+//   void arm(Poll p)      登记挂起的等待节点, 事件发生时唤醒p, 可能被调用多次
+//   void cancel()         超时, 取消事件一侧的节点或定时器
+//   Timed<Result> take()  事件发生后取出结果
+template <typename A> struct DeadlineSource;
+
+template <typename T> struct DeadlineSource<Promise<T>> {
+    using Result = T;
+    Promise<T> promise;
+    DeadlineSource(Promise<T> p) : promise(std::move(p)) {}
+    bool ready() const { return promise.is_settled(); }
+    void arm(Poll p) { promise.add_waiter(p); }
+    void cancel() {} // 等待节点删除后, 失效的句柄在下次唤醒或登记时丢弃
+    // 调用者没有保留Promise时结果直接移动出来
+    Timed<T> take() {
+        if (promise.is_rejected())
+            return {WaitStatus::CLOSED};
+        if constexpr (std::is_void_v<T>)
+            return {};
+        else
+            return {WaitStatus::OK, std::move(promise.take().value)};
+    }
+};
+
+// 等待流中的下一个数据, 取出后从流中弹出; 流结束且没有数据时为CLOSED
+template <typename T> struct DeadlineSource<Stream<T>> {
+    using Result = T;
+    Rc<typename Stream<T>::Consumer> c;
+    DeadlineSource(const Stream<T> &s) : c(s.consumer()) {}
+    bool ready() const { return !c->buf.is_empty() || c->finished; }
+    void arm(Poll p) { c->waker.add(p); }
+    void cancel() {}
+    Timed<T> take() {
+        if (c->buf.is_empty())
+            return {WaitStatus::CLOSED};
+        Timed<T> r{WaitStatus::OK, std::move(c->buf.front())};
+        c->pop();
+        return r;
+    }
+};
+
+// 睡眠: 第一次arm时启动定时器, 超时或销毁时删除
+struct _DeadlineSleep {
+    using Result = void;
+    Timeout timer;
+    bool fired = false;
+    _DeadlineSleep() = default;
+    _DeadlineSleep(const _DeadlineSleep &) = delete;
+    ~_DeadlineSleep() { timer.stop(); }
+    bool ready() const { return fired; }
+    void cancel() { timer.stop(); }
+    Timed<void> take() { return {}; }
+};
+
+template <> struct DeadlineSource<SleepAwaiter> : _DeadlineSleep {
+    u32 ms;
+    DeadlineSource(SleepAwaiter s) : ms(s._ms) {}
+    void arm(Poll p) {
+        if (timer.is_null())
+            timer = set_timeout(ms, [this, p] {
+                fired = true;
+                p.wake();
+            });
+    }
+};
+
+template <> struct DeadlineSource<SleepUsAwaiter> : _DeadlineSleep {
+    u32 us;
+    DeadlineSource(SleepUsAwaiter s) : us(s._us) {}
+    void arm(Poll p) {
+        if (timer.is_null())
+            timer = set_timeout_us(us, [this, p] {
+                fired = true;
+                p.wake();
+            });
+    }
+};
+
+// 子协程在独立的任务中运行, 超时时结束该任务, 任务的节点和定时器随之删除, 协程帧随任务销毁
+template <typename T> struct _DeadlineAsyncState {
+    Timed<T> result;
+    bool done = false;
+    bool cancelled = false;
+    Poll waiter;
+};
+
+template <typename T> Async<void> _deadline_child(Async<T> child, Shared<_DeadlineAsyncState<T>> st) {
+    if constexpr (std::is_void_v<T>)
+        co_await child;
+    else
+        st->result.value = co_await child;
+    st->done = true;
+    st->waiter.wake();
+}
+
+template <typename T> struct DeadlineSource<Async<T>> {
+    using Result = T;
+    Shared<_DeadlineAsyncState<T>> st;
+    Shared<Task> task;
+
+    DeadlineSource(Async<T> child) : st(make_shared<_DeadlineAsyncState<T>>()) {
+        auto holder = make_shared<Async<T>>(std::move(child));
+        auto st = this->st;
+        task = start_task("with_timeout", [holder, st](Task *) {
+            if (!st->cancelled)
+                _deadline_child(std::move(*holder), st).detach();
+        });
+    }
+    DeadlineSource(const DeadlineSource &) = delete;
+    ~DeadlineSource() { cancel(); }
+    bool ready() const { return st->done; }
+    void arm(Poll p) { st->waiter = p; }
+    void cancel() {
+        if (!st->done && !st->cancelled) {
+            st->cancelled = true;
+            task->terminal();
+        }
+    }
+    Timed<T> take() { return std::move(st->result); }
+};
+
+// 等待节点和定时器, 协程被提前销毁时一并删除
+struct _Deadline {
+    Poll wait;
+    Timeout timer;
+    bool timed_out = false;
+    ~_Deadline() {
+        wait.remove();
+        timer.stop();
+    }
+};
+
+template <typename S> struct _DeadlineAwaiter {
+    S *src;
+    _Deadline *d;
+    u32 ms;
+    bool await_ready() const { return src->ready(); }
+    void await_suspend(std::coroutine_handle<> h) {
+        auto src = this->src;
+        auto d = this->d;
+        d->wait = set_poll([src, d, h](Poll p) {
+            if (src->ready()) {
+                d->timer.stop();
+                p.remove();
+                h.resume();
+            } else {
+                src->arm(p);
+                p.park();
+            }
+        });
+        src->arm(d->wait);
+        d->wait.park();
+        d->timer = set_timeout(ms, [src, d, h] {
+            d->timed_out = true;
+            d->wait.remove();
+            src->cancel();
+            h.resume();
+        });
+    }
+    void await_resume() {}
+};
+
+template <typename A> Async<Timed<typename DeadlineSource<A>::Result>> with_timeout(A awaitable, u32 ms) {
+    DeadlineSource<A> src(std::move(awaitable));
+    _Deadline d;
+    if (!src.ready())
+        co_await _DeadlineAwaiter<DeadlineSource<A>>{&src, &d, ms};
+    if (d.timed_out)
+        co_return Timed<typename DeadlineSource<A>::Result>{WaitStatus::TIMEOUT};
+    co_return src.take();
+}
+
+extern void _test_deadline();
+
+#endif // __cplusplus >= 202002L
+
+#endif // DEADLINE_H
@@ -0,0 +1,145 @@
+#include <frame_pool.h>
+#include <poll.h>
+#include <console.h>
+#include <stdio.h>
+#include <assert.h>
+#include <new>
+
+// 帧头放在每个块的开头, 记录所属的池和级别, 保持帧本身按默认new的对齐方式对齐
+struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) FramePool::Header {
+    FramePool *pool;
+    u32 cls;
+};
+
+static FrameStats _frame_stats = {};
+
+static size_t block_size(u32 cls) {
+    return (size_t)1 << (FRAME_POOL_MIN_SHIFT + cls);
+}
+
+// 全局池不析构, 程序退出时静态对象析构顺序不确定, 仍可能有帧在释放
+static FramePool &global_pool() {
+    static FramePool *pool = new FramePool();
+    return *pool;
+}
+
+FramePool::~FramePool() {
+    for (auto chunk : _chunks)
+        ::operator delete(chunk);
+}
+
+void *FramePool::alloc(size_t size) {
+    size_t total = size + sizeof(Header);
+    u32 cls = 0;
+    while (cls < CLASSES && total > block_size(cls))
+        cls++;
+    Header *h;
+    if (cls == OVERSIZE) {
+        h = (Header *)::operator new(total);
+        _frame_stats.oversize++;
+    } else {
+        if (_free[cls] == nullptr) {
+            // 申请一整块切分成空闲块
+            size_t bs = block_size(cls);
+            auto chunk = (char *)::operator new(bs * FRAME_POOL_CHUNK_BLOCKS);
+            _chunks.push_back(chunk);
+            _frame_stats.pool_bytes += bs * FRAME_POOL_CHUNK_BLOCKS;
+            for (u32 i = 0; i < FRAME_POOL_CHUNK_BLOCKS; ++i) {
+                void *block = chunk + i * bs;
+                *(void **)block = _free[cls];
+                _free[cls] = block;
+            }
+        }
+        h = (Header *)_free[cls];
+        _free[cls] = *(void **)h;
+    }
+    h->pool = this;
+    h->cls = cls;
+    _live++;
+    _frame_stats.allocs++;
+    if (++_frame_stats.live > _frame_stats.peak)
+        _frame_stats.peak = _frame_stats.live;
+    return h + 1;
+}
+
+void FramePool::free(void *p) {
+    if (p == nullptr)
+        return;
+    Header *h = (Header *)p - 1;
+    FramePool *pool = h->pool;
+    if (h->cls == OVERSIZE) {
+        ::operator delete(h);
+    } else {
+        *(void **)h = pool->_free[h->cls];
+        pool->_free[h->cls] = h;
+    }
+    pool->_live--;
+    _frame_stats.live--;
+    if (pool->_orphan && pool->_live == 0)
+        delete pool;
+}
+
+void FramePool::release() {
+    if (_live == 0) {
+        delete this;
+    } else {
+        _orphan = true;
+    }
+}
+
+const FrameStats &get_frame_stats() {
+    return _frame_stats;
+}
+
+void *frame_alloc(size_t size) {
+    auto task = get_current_task();
+    FramePool *arena = task ? task->frame_arena() : nullptr;
+    return (arena ? *arena : global_pool()).alloc(size);
+}
+
+void frame_free(void *p) {
+    FramePool::free(p);
+}
+
+void cmd_frames(Env e) {
+    auto &io = e.io();
+    auto &st = get_frame_stats();
+    io.printf("frames: allocs %u, live %u, peak %u, oversize %u\n", (unsigned)st.allocs,
+              (unsigned)st.live, (unsigned)st.peak, (unsigned)st.oversize);
+    io.printf("pool: %u bytes\n", (unsigned)st.pool_bytes);
+    io.flush();
+    e.exit(0);
+}
+
+void _test_frame_pool() {
+    printf("Test FramePool\n");
+    FrameStats base = get_frame_stats();
+
+    // 同级别的块释放后复用
+    void *a = frame_alloc(40);
+    void *b = frame_alloc(40);
+    assert(a != b && ((uintptr_t)a % __STDCPP_DEFAULT_NEW_ALIGNMENT__) == 0);
+    assert(get_frame_stats().live == base.live + 2);
+    frame_free(a);
+    void *c = frame_alloc(30);
+    assert(c == a);
+    frame_free(b);
+    frame_free(c);
+    assert(get_frame_stats().live == base.live);
+    assert(get_frame_stats().peak >= base.live + 2);
+    assert(get_frame_stats().allocs == base.allocs + 3);
+
+    // 超过最大级别的帧直接从堆上分配
+    void *big = frame_alloc(block_size(FramePool::CLASSES));
+    assert(get_frame_stats().oversize == base.oversize + 1);
+    frame_free(big);
+
+    // 独立分区: 释放时仍有存活的帧, 延迟到最后一帧释放
+    auto arena = new FramePool();
+    void *f = arena->alloc(100);
+    assert(arena->live() == 1);
+    arena->release();
+    FramePool::free(f);
+    assert(get_frame_stats().live == base.live);
+    printf("Test FramePool PASS\n");
+}
@@ -0,0 +1,59 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <types.h>
+
+// 协程帧内存池: 按大小分级的空闲链表, 块从一次申请的整块中切分, 释放后留在池中复用,
+// 避免协程调用走全局堆, 减少MCU上的碎片. 超过最大级别的帧直接从堆上分配并计数.
+// 只能在轮询循环中使用.
+#ifndef FRAME_POOL_MIN_SHIFT
+#define FRAME_POOL_MIN_SHIFT 6 // 最小级别64字节
+#endif
+#ifndef FRAME_POOL_CLASSES
+#define FRAME_POOL_CLASSES 5 // 64, 128, 256, 512, 1024
+#endif
+#ifndef FRAME_POOL_CHUNK_BLOCKS
+#define FRAME_POOL_CHUNK_BLOCKS 8 // 每次向堆申请的块数
+#endif
+
+class FramePool {
+public:
+    static constexpr u32 CLASSES = FRAME_POOL_CLASSES;
+    static constexpr u32 OVERSIZE = CLASSES;
+
+    FramePool() = default;
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+    ~FramePool();
+
+    void *alloc(size_t size);
+    static void free(void *p);
+
+    u32 live() const { return _live; }
+    // 任务结束时释放独立分区: 仍有存活的帧时延迟到最后一帧释放
+    void release();
+
+private:
+    struct Header;
+    void *_free[CLASSES] = {};
+    Vec<void *> _chunks;
+    u32 _live = 0;
+    bool _orphan = false;
+};
+
+struct FrameStats {
+    u32 allocs;     // 累计分配的帧数
+    u32 live;       // 当前存活的帧数
+    u32 peak;       // 存活帧数的最高水位
+    u32 oversize;   // 超过最大级别, 直接从堆上分配的帧数(累计)
+    u32 pool_bytes; // 各内存池向堆申请的总字节数
+};
+extern const FrameStats &get_frame_stats();
+
+// 协程帧分配入口: 当前任务开启了独立分区时从分区分配, 否则从全局池分配
+extern void *frame_alloc(size_t size);
+extern void frame_free(void *p);
+
+extern void _test_frame_pool();
+
+#endif // FRAME_POOL_H
@@ -0,0 +1,48 @@
+#include <types.h>
+#include <stdio.h>
+#include <assert.h>
+
+uint32_t _inplace_func_heap_count = 0;
+
+void _test_func() {
+    printf("Test InplaceFunc\n");
+    u32 heap_count = inplace_func_heap_count();
+
+    // 小捕获内联存放, 不分配内存
+    auto counter = make_shared<int>(0);
+    InplaceFunc<void(int)> add = [counter](int x) { *counter += x; };
+    add(2);
+    add(3);
+    assert(*counter == 5);
+    assert(inplace_func_heap_count() == heap_count);
+
+    // 移动后原对象为空, 捕获只析构一次
+    InplaceFunc<void(int)> moved = std::move(add);
+    assert(!add && moved);
+    moved(1);
+    assert(*counter == 6 && counter.use_count() == 2);
+    moved = nullptr;
+    assert(counter.use_count() == 1);
+
+    // 仅移动的捕获
+    auto owned = make_unique<int>(7);
+    InplaceFunc<int()> get = [owned = std::move(owned)] { return *owned; };
+    assert(get() == 7);
+
+    // 小容量移入大容量, 不重新包装
+    InplaceFunc<int(), 64> wide = std::move(get);
+    assert(!get && wide() == 7);
+    assert(inplace_func_heap_count() == heap_count);
+
+    // 超出容量退回堆上并计数
+    struct Big {
+        char data[FUNC_INPLACE_SIZE + 1];
+    } big{};
+    big.data[0] = 42;
+    InplaceFunc<int()> large = [big] { return (int)big.data[0]; };
+    assert(large() == 42);
+    assert(inplace_func_heap_count() == heap_count + 1);
+    InplaceFunc<int()> large2 = std::move(large);
+    assert(large2() == 42);
+    printf("Test InplaceFunc PASS\n");
+}
@@ -0,0 +1,148 @@
+#ifndef FUNC_H
+#define FUNC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// InplaceFunc 默认内联容量(字节), 可在编译选项中覆盖
+#ifndef FUNC_INPLACE_SIZE
+#define FUNC_INPLACE_SIZE 32
+#endif
+
+// 超出内联容量而落到堆上的可调用对象个数(累计), 用于发现需要调大容量的回调
+extern uint32_t _inplace_func_heap_count;
+inline uint32_t inplace_func_heap_count() { return _inplace_func_heap_count; }
+
+template <typename Sig, size_t N = FUNC_INPLACE_SIZE> class InplaceFunc;
+
+// 类型擦除的操作表, 只与签名有关, 不同容量的InplaceFunc可以共用
+template <typename R, typename... Args> struct _FuncOps {
+    R (*invoke)(void *obj, Args &&...args);
+    void (*move)(void *dst, void *src); // 移动构造到dst并析构src
+    void (*destroy)(void *obj);
+
+    // 对象存放在缓冲区内
+    template <typename F> struct Inplace {
+        static R invoke_(void *obj, Args &&...args) {
+            return (*static_cast<F *>(obj))(std::forward<Args>(args)...);
+        }
+        static void move_(void *dst, void *src) {
+            new (dst) F(std::move(*static_cast<F *>(src)));
+            static_cast<F *>(src)->~F();
+        }
+        static void destroy_(void *obj) { static_cast<F *>(obj)->~F(); }
+        static constexpr _FuncOps ops = {invoke_, move_, destroy_};
+    };
+
+    // 对象在堆上, 缓冲区内只存指针
+    template <typename F> struct Heap {
+        static R invoke_(void *obj, Args &&...args) {
+            return (**static_cast<F **>(obj))(std::forward<Args>(args)...);
+        }
+        static void move_(void *dst, void *src) {
+            *static_cast<F **>(dst) = *static_cast<F **>(src);
+        }
+        static void destroy_(void *obj) { delete *static_cast<F **>(obj); }
+        static constexpr _FuncOps ops = {invoke_, move_, destroy_};
+    };
+};
+
+// 仅移动的可调用对象包装, 捕获不超过N字节时直接存放在对象内部, 不分配内存.
+// 超出容量时退回堆上分配并计数(见 inplace_func_heap_count).
+// 容量较小的InplaceFunc可以直接移动到同签名容量较大的InplaceFunc中, 不会多包一层.
+template <typename R, typename... Args, size_t N> class InplaceFunc<R(Args...), N> {
+    template <typename, size_t> friend class InplaceFunc;
+
+    using Ops = _FuncOps<R, Args...>;
+
+    template <typename F> static constexpr bool fits_inplace() {
+        return sizeof(F) <= N && alignof(F) <= alignof(uint64_t) &&
+               std::is_nothrow_move_constructible_v<F>;
+    }
+
+    template <typename T> struct is_inplace_func : std::false_type {};
+    template <size_t M> struct is_inplace_func<InplaceFunc<R(Args...), M>> : std::true_type {};
+
+public:
+    static_assert(N >= sizeof(void *), "InplaceFunc capacity too small");
+    static constexpr size_t CAPACITY = N;
+
+    InplaceFunc() noexcept = default;
+    InplaceFunc(std::nullptr_t) noexcept {}
+
+    template <typename F, typename D = std::decay_t<F>,
+              typename = std::enable_if_t<!is_inplace_func<D>::value &&
+                                          std::is_invocable_r_v<R, D &, Args...>>>
+    InplaceFunc(F &&f) {
+        if constexpr (fits_inplace<D>()) {
+            new (_buf) D(std::forward<F>(f));
+            _ops = &Ops::template Inplace<D>::ops;
+        } else {
+            *reinterpret_cast<D **>(_buf) = new D(std::forward<F>(f));
+            _ops = &Ops::template Heap<D>::ops;
+            _inplace_func_heap_count++;
+        }
+    }
+
+    InplaceFunc(InplaceFunc &&other) noexcept { take(other); }
+
+    // 从容量不大于自身的同签名InplaceFunc移动
+    template <size_t M, typename = std::enable_if_t<(M < N)>>
+    InplaceFunc(InplaceFunc<R(Args...), M> &&other) noexcept {
+        take(other);
+    }
+
+    InplaceFunc(const InplaceFunc &) = delete;
+    InplaceFunc &operator=(const InplaceFunc &) = delete;
+
+    InplaceFunc &operator=(InplaceFunc &&other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    InplaceFunc &operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    ~InplaceFunc() { reset(); }
+
+    explicit operator bool() const { return _ops != nullptr; }
+
+    R operator()(Args... args) const {
+        assert(_ops);
+        return _ops->invoke(_buf, std::forward<Args>(args)...);
+    }
+
+    void reset() {
+        if (_ops) {
+            auto ops = _ops;
+            _ops = nullptr;
+            ops->destroy(_buf);
+        }
+    }
+
+private:
+    template <size_t M> void take(InplaceFunc<R(Args...), M> &other) {
+        if (other._ops) {
+            other._ops->move(_buf, other._buf);
+            _ops = other._ops;
+            other._ops = nullptr;
+        }
+    }
+
+    alignas(uint64_t) mutable unsigned char _buf[N];
+    const Ops *_ops = nullptr;
+};
+
+// Test
+extern void _test_func();
+
+#endif // FUNC_H
@@ -4,23 +4,18 @@
  */
 
 #include <poll.h>
+#include <timeout.h>
 #include <console.h>
+#include <frame_pool.h>
+#include <task_group.h>
 #include <types.h>
+#include <atomic>
 
 #ifdef QT_CORE_LIB
 #include <QDebug>
 #include <QString>
 #endif
 
-static IdType new_id() {
-    static IdType _next_id = 0;
-    IdType id = ++_next_id;
-    if (id == 0) {
-        assert(0 && "IdType overflow");
-    }
-    return id;
-}
-
 Poll::Poll(IdType id) { this->id = id; }
 
 Poll::Poll() { id = 0; }
@@ -31,45 +26,485 @@ Poll::Poll(const Poll &other) { id = other.id; }
 enum PollFlag {
     PF_ONCE = 1u << 0,
     PF_DELETE = 1u << 1,
+    PF_USED = 1u << 2,
+    PF_TIMER = 1u << 3,
+    PF_MAIN = 1u << 4,  // 任务主节点
+    PF_WAIT = 1u << 5,  // 挂起, 不参与轮询
 };
 
 struct PollNode {
-    IdType _id;
-    uint _flags;
-    PollFunc _cb;
+    u32 _gen = 0;
+    uint _flags = 0;
+    u32 _next_free = 0;
+    PollFunc_1 _cb;
     Shared<Task> _task;
-    PollNode(Shared<Task> task, IdType id, uint32_t flags, const PollFunc &cb) {
-        _id = id;
-        _flags = flags;
-        _cb = cb;
-        _task = task;
-    }
-    PollNode(const PollNode &other) {
-        _id = other._id;
-        _flags = other._flags;
-        _cb = other._cb;
-        _task = other._task;
+    // 定时器节点: 到期时间, 周期, 时间轮双向链表
+    u32 _expire = 0;
+    u32 _interval = 0;
+    u32 _bucket = 0xffffffff;
+    u32 _tprev = 0xffffffff;
+    u32 _tnext = 0xffffffff;
+    // 所属任务的子节点双向链表
+    u32 _cprev = 0xffffffff;
+    u32 _cnext = 0xffffffff;
+    // 所在的调度队列(就绪/本轮/回收)
+    u32 _queue = 0;
+    u32 _qprev = 0xffffffff;
+    u32 _qnext = 0xffffffff;
+    // 最近登记的Waker代号, 0为未登记
+    u32 _waker = 0;
+};
+
+// 轮询节点注册表(slab/slot-map)
+// 节点按固定大小的块连续存放, 块一旦分配地址不再移动, 回调执行期间新增节点不会使其失效.
+// 空闲槽位串成单链表复用, 句柄携带槽位号和代数, 查找/删除/存活检查均为O(1).
+// 可执行的节点串在就绪队列中, 挂起的节点和定时器不在任何队列, 每轮循环只处理就绪的节点.
+class PollSlab {
+public:
+    static constexpr u32 CHUNK_SHIFT = 5;
+    static constexpr u32 CHUNK_SIZE = 1u << CHUNK_SHIFT;
+    static constexpr u32 NIL = 0xffffffff;
+
+    enum Queue {
+        Q_NONE = 0,     // 挂起/定时器/正在执行
+        Q_READY,        // 就绪, 下一轮执行
+        Q_CURRENT,      // 本轮待执行
+        Q_DEAD,         // 已删除, 等待回收
+        Q_COUNT,
+    };
+
+    // 槽位总数(包括空闲槽位), 轮询时遍历[0, size)
+    u32 size() const { return _size; }
+    // 活动节点数
+    u32 count() const { return _count; }
+
+    PollNode &at(u32 slot) {
+        return _chunks[slot >> CHUNK_SHIFT][slot & (CHUNK_SIZE - 1)];
+    }
+
+    Poll alloc(Shared<Task> task, uint flags, PollFunc_1 cb) {
+        u32 slot;
+        if (_free_head != NIL) {
+            slot = _free_head;
+            _free_head = at(slot)._next_free;
+        } else {
+            if ((_size >> CHUNK_SHIFT) >= _chunks.size()) {
+                _chunks.push_back(make_unique<PollNode[]>(CHUNK_SIZE));
+            }
+            slot = _size++;
+        }
+        auto &node = at(slot);
+        node._flags = flags | PF_USED;
+        node._waker = 0;
+        node._cb = std::move(cb);
+        node._task = task;
+        if ((flags & PF_TIMER) == 0)
+            enqueue(slot, Q_READY);
+        if (task && (flags & PF_MAIN) == 0) {
+            // 挂入任务的子节点链表
+            node._cprev = NIL;
+            node._cnext = task->_poll_head;
+            if (task->_poll_head != NIL)
+                at(task->_poll_head)._cprev = slot;
+            task->_poll_head = slot;
+            task->_poll_live++;
+        }
+        _count++;
+        return Poll::make(slot, node._gen);
     }
+
+    void release(u32 slot) {
+        auto &node = at(slot);
+        if (node._task && (node._flags & PF_MAIN) == 0) {
+            if (node._cprev != NIL)
+                at(node._cprev)._cnext = node._cnext;
+            else
+                node._task->_poll_head = node._cnext;
+            if (node._cnext != NIL)
+                at(node._cnext)._cprev = node._cprev;
+        }
+        // 先更新槽位状态再析构回调和任务, 析构过程中可能重新申请节点
+        PollFunc_1 cb = std::move(node._cb);
+        Shared<Task> task = std::move(node._task);
+        node._cb = nullptr;
+        node._flags = 0;
+        node._gen++;
+        node._next_free = _free_head;
+        _free_head = slot;
+        _count--;
+    }
+
+    // 按句柄查找节点, 句柄失效(已回收或代数不符)返回nullptr
+    PollNode *find(Poll p) {
+        if (p.is_null() || p.slot() >= _size)
+            return nullptr;
+        auto &node = at(p.slot());
+        if ((node._flags & PF_USED) == 0 || node._gen != p.generation())
+            return nullptr;
+        return &node;
+    }
+
+    // 遍历所有在用节点
+    template <typename F> void for_each(F f) {
+        for (u32 i = 0; i < _size; ++i) {
+            auto &node = at(i);
+            if (node._flags & PF_USED)
+                f(Poll::make(i, node._gen), node);
+        }
+    }
+
+    // 遍历任务的子节点(不含主节点), 回调中不得回收节点
+    template <typename F> void for_each_child(const Task *task, F f) {
+        for (u32 i = task->_poll_head; i != NIL; i = at(i)._cnext) {
+            f(i, at(i));
+        }
+    }
+
+    // 子节点被标记删除, 任务没有活动子节点时唤醒主节点, 由主节点在下次轮到时确认退出
+    // (同一轮中可能又创建了新的子节点)
+    void child_deleted(Task *task) {
+        if (--task->_poll_live == 0 && task->_run) {
+            Poll main(task->_task_id);
+            if (find(main))
+                wake(main.slot());
+        }
+    }
+
+    // 删除主节点, 主节点绑定了thread指针, 将被释放
+    void retire(Task *task) {
+        Poll main(task->_task_id);
+        if (find(main)) {
+            kill(main.slot());
+        }
+        task->_run = false;
+        task->_exit_waker.wake();
+        task->exited();
+    }
+
+    // 标记删除并放入回收队列, 正在执行的节点由循环在回调返回后处理
+    void kill(u32 slot) {
+        auto &node = at(slot);
+        node._flags |= PF_DELETE;
+        if (slot != _running) {
+            dequeue(slot);
+            enqueue(slot, Q_DEAD);
+        }
+    }
+
+    // 挂起节点, 离开就绪队列
+    void park(u32 slot) {
+        auto &node = at(slot);
+        if (node._flags & (PF_DELETE | PF_TIMER))
+            return;
+        node._flags |= PF_WAIT;
+        if (slot != _running)
+            dequeue(slot);
+    }
+
+    // 唤醒挂起的节点, 放入就绪队列
+    void wake(u32 slot) {
+        auto &node = at(slot);
+        if ((node._flags & PF_WAIT) == 0 || (node._flags & PF_DELETE))
+            return;
+        node._flags &= ~PF_WAIT;
+        if (slot != _running)
+            enqueue(slot, Q_READY);
+    }
+
+    void enqueue(u32 slot, u32 q) {
+        auto &node = at(slot);
+        node._queue = q;
+        node._qnext = NIL;
+        node._qprev = _tails[q];
+        if (_tails[q] != NIL)
+            at(_tails[q])._qnext = slot;
+        else
+            _heads[q] = slot;
+        _tails[q] = slot;
+    }
+
+    void dequeue(u32 slot) {
+        auto &node = at(slot);
+        if (node._queue == Q_NONE)
+            return;
+        u32 q = node._queue;
+        if (node._qprev != NIL)
+            at(node._qprev)._qnext = node._qnext;
+        else
+            _heads[q] = node._qnext;
+        if (node._qnext != NIL)
+            at(node._qnext)._qprev = node._qprev;
+        else
+            _tails[q] = node._qprev;
+        node._queue = Q_NONE;
+        node._qprev = NIL;
+        node._qnext = NIL;
+    }
+
+    // 取出队首节点, 队列为空返回NIL
+    u32 pop(u32 q) {
+        u32 slot = _heads[q];
+        if (slot != NIL)
+            dequeue(slot);
+        return slot;
+    }
+
+    bool is_empty(u32 q) const { return _heads[q] == NIL; }
+
+    // 把队列from整体接到队列to之后
+    void splice(u32 from, u32 to) {
+        if (_heads[from] == NIL)
+            return;
+        for (u32 i = _heads[from]; i != NIL; i = at(i)._qnext)
+            at(i)._queue = to;
+        if (_tails[to] != NIL) {
+            at(_tails[to])._qnext = _heads[from];
+            at(_heads[from])._qprev = _tails[to];
+        } else {
+            _heads[to] = _heads[from];
+        }
+        _tails[to] = _tails[from];
+        _heads[from] = NIL;
+        _tails[from] = NIL;
+    }
+
+    // 正在执行回调的节点
+    u32 running() const { return _running; }
+    void set_running(u32 slot) { _running = slot; }
+
+private:
+    Vec<Unique<PollNode[]>> _chunks;
+    u32 _size = 0;
+    u32 _count = 0;
+    u32 _free_head = NIL;
+    u32 _running = NIL;
+    u32 _heads[Q_COUNT] = {NIL, NIL, NIL, NIL};
+    u32 _tails[Q_COUNT] = {NIL, NIL, NIL, NIL};
 };
 
-List<PollNode> _poll_list = {};
+static PollSlab _poll_slab;
 Shared<Task> _current_task = nullptr;
 
-Poll set_poll(const PollFunc &cb) {
-    IdType id = new_id();
-    _poll_list.push_back(PollNode(_current_task, id, 0, cb));
-    return Poll{id};
+// 分层时间轮(1ms精度), 由调度器统一推进
+// 第0层64格覆盖64ms, 之后每层64格, 5层共覆盖2^30ms, 更远的定时器挂在最高层并在降级时重新计算.
+// 插入/取消为O(1), 每轮循环只读取一次时钟, 未到期的定时器不会被调用.
+class TimerWheel {
+public:
+    static constexpr u32 BITS = 6;
+    static constexpr u32 SLOTS = 1u << BITS;
+    static constexpr u32 MASK = SLOTS - 1;
+    static constexpr u32 LEVELS = 5;
+    static constexpr u32 MAX_DELTA = (1u << (BITS * LEVELS)) - 1;
+    static constexpr u32 WORK = LEVELS * SLOTS;      // 正在处理的到期链表
+    static constexpr u32 DEFER = LEVELS * SLOTS + 1; // advance中加入的已到期节点, 下一次advance处理
+    static constexpr u32 NIL = PollSlab::NIL;
+
+    TimerWheel() {
+        for (auto &head : _heads)
+            head = NIL;
+    }
+
+    u32 count() const { return _count; }
+
+    void add(u32 slot) {
+        if (_advancing) {
+            // 到期回调中加入的节点: 已到期的留到下一次advance, 不进入正在处理的格子
+            if (tick_diff(_poll_slab.at(slot)._expire, _now) <= 0)
+                link(DEFER, slot);
+            else
+                place(slot);
+        } else {
+            if (_count == 0) {
+                // 空闲期间不推进时间轮, 重新对齐到当前时间
+                _base = get_tick_ms();
+            }
+            place(slot);
+        }
+        _count++;
+    }
+
+    void del(u32 slot) {
+        auto &node = _poll_slab.at(slot);
+        if (node._bucket == NIL)
+            return;
+        unlink(slot);
+        _count--;
+    }
+
+    // 计算最近的到期时间, 时间轮为空返回false
+    // 每层从当前位置向后找到第一个非空格子, 取其中节点的最小到期时间, 仅在空闲时调用
+    bool next_expire(u32 &expire) {
+        if (_count == 0)
+            return false;
+        if (_heads[DEFER] != NIL) {
+            expire = _poll_slab.at(_heads[DEFER])._expire;
+            return true;
+        }
+        bool found = false;
+        for (u32 level = 0; level < LEVELS; ++level) {
+            u32 pos = (_base >> (BITS * level)) & MASK;
+            // 上层当前格子若已降级过, 只含有绕了一整圈的节点, 从下一格开始找
+            u32 start = (level > 0 && (_base & ((1u << (BITS * level)) - 1)) != 0) ? 1 : 0;
+            for (u32 k = start; k < start + SLOTS; ++k) {
+                u32 i = _heads[level * SLOTS + ((pos + k) & MASK)];
+                if (i == NIL)
+                    continue;
+                for (; i != NIL; i = _poll_slab.at(i)._tnext) {
+                    u32 e = _poll_slab.at(i)._expire;
+                    if (!found || tick_diff(e, expire) < 0)
+                        expire = e;
+                    found = true;
+                }
+                break;
+            }
+        }
+        return found;
+    }
+
+    // 推进到now, 依次对到期节点调用fire(slot)
+    template <typename F> void advance(u32 now, F fire) {
+        _advancing = true;
+        _now = now;
+        // 上一次advance中加入的已到期节点
+        if (_heads[DEFER] != NIL) {
+            move_to_work(DEFER);
+            fire_work(fire);
+        }
+        while (tick_reached(now, _base)) {
+            if (_count == 0) {
+                _base = now + 1;
+                break;
+            }
+            u32 index = _base & MASK;
+            if (index == 0) {
+                // 低层转完一圈, 把上层对应格子的定时器降级
+                for (u32 level = 1; level < LEVELS; ++level) {
+                    u32 i = (_base >> (BITS * level)) & MASK;
+                    cascade(level * SLOTS + i);
+                    if (i != 0)
+                        break;
+                }
+            }
+            _base++;
+            move_to_work(index);
+            fire_work(fire);
+        }
+        _advancing = false;
+    }
+
+private:
+    u32 _heads[LEVELS * SLOTS + 2];
+    u32 _base = 0;  // 下一个待处理的tick
+    u32 _count = 0;
+    u32 _now = 0;   // advance的目标时间
+    bool _advancing = false;
+
+    template <typename F> void fire_work(F &fire) {
+        while (_heads[WORK] != NIL) {
+            u32 slot = _heads[WORK];
+            del(slot);
+            fire(slot);
+        }
+    }
+
+    // 按到期时间与_base的距离挂入对应层的格子
+    void place(u32 slot) {
+        u32 expire = _poll_slab.at(slot)._expire;
+        s32 delta = tick_diff(expire, _base);
+        u32 bucket;
+        if (delta < 0) {
+            // 已经过期, 下个tick处理
+            bucket = _base & MASK;
+        } else {
+            if ((u32)delta > MAX_DELTA) {
+                expire = _base + MAX_DELTA;
+                delta = MAX_DELTA;
+            }
+            u32 level = 0;
+            while ((u32)delta >= (1u << (BITS * (level + 1))))
+                level++;
+            bucket = level * SLOTS + ((expire >> (BITS * level)) & MASK);
+        }
+        link(bucket, slot);
+    }
+
+    void link(u32 bucket, u32 slot) {
+        auto &node = _poll_slab.at(slot);
+        node._bucket = bucket;
+        node._tprev = NIL;
+        node._tnext = _heads[bucket];
+        if (_heads[bucket] != NIL)
+            _poll_slab.at(_heads[bucket])._tprev = slot;
+        _heads[bucket] = slot;
+    }
+
+    void unlink(u32 slot) {
+        auto &node = _poll_slab.at(slot);
+        if (node._tprev != NIL)
+            _poll_slab.at(node._tprev)._tnext = node._tnext;
+        else
+            _heads[node._bucket] = node._tnext;
+        if (node._tnext != NIL)
+            _poll_slab.at(node._tnext)._tprev = node._tprev;
+        node._bucket = NIL;
+        node._tprev = NIL;
+        node._tnext = NIL;
+    }
+
+    void move_to_work(u32 bucket) {
+        u32 head = _heads[bucket];
+        _heads[bucket] = NIL;
+        _heads[WORK] = head;
+        for (u32 i = head; i != NIL; i = _poll_slab.at(i)._tnext)
+            _poll_slab.at(i)._bucket = WORK;
+    }
+
+    void cascade(u32 bucket) {
+        u32 i = _heads[bucket];
+        _heads[bucket] = NIL;
+        while (i != NIL) {
+            u32 next = _poll_slab.at(i)._tnext;
+            // 降级不经过add, 时间轮暂时为空时也不能重新对齐_base
+            place(i);
+            i = next;
+        }
+    }
+};
+
+static TimerWheel _timer_wheel;
+
+// 标记删除节点, 由轮询循环回收
+// 定时器立即从时间轮摘除, 任务的最后一个活动子节点删除时任务随即退出
+static void delete_node(u32 slot) {
+    auto &node = _poll_slab.at(slot);
+    if (node._flags & PF_DELETE)
+        return;
+    if (node._flags & PF_TIMER)
+        _timer_wheel.del(slot);
+    _poll_slab.kill(slot);
+    if (node._task && (node._flags & PF_MAIN) == 0)
+        _poll_slab.child_deleted(node._task.get());
+}
+
+// 回收已删除的节点
+static void release_dead() {
+    u32 slot;
+    while ((slot = _poll_slab.pop(PollSlab::Q_DEAD)) != PollSlab::NIL) {
+        _poll_slab.release(slot);
+    }
+}
+
+Poll set_poll(PollFunc cb) {
+    return _poll_slab.alloc(_current_task, 0, [cb = std::move(cb)](Poll) { cb(); });
 }
 
-Poll set_poll(const PollFunc_1 &cb) {
-    auto id = new_id();
-    _poll_list.push_back(PollNode(_current_task, id, 0, std::bind(cb, Poll{id})));
-    return Poll{id};
+Poll set_poll(PollFunc_1 cb) {
+    return _poll_slab.alloc(_current_task, 0, std::move(cb));
 }
 
-void set_once(const OnceFunc &cb) {
+void set_once(OnceFunc cb) {
     // set once
-    _poll_list.push_back(PollNode(_current_task, new_id(), PF_ONCE, cb));
+    _poll_slab.alloc(_current_task, PF_ONCE, [cb = std::move(cb)](Poll) { cb(); });
 }
 
 bool Poll::is_null() const { return id == 0; }
@@ -79,116 +514,445 @@ bool Poll::is_not_null() const { return id != 0; }
 void Poll::set_null() { id = 0; }
 
 bool Poll::is_active() const {
-    if (id == 0)
-        return false;
-    // 遍历_pollItems, 查找是否有相同的id
-    for (auto &item : _poll_list) {
-        if (item._id == id) {
-            return true;
-        }
-    }
-    return false;
+    auto node = _poll_slab.find(*this);
+    return node && (node->_flags & PF_DELETE) == 0;
 }
 
 void Poll::remove() const {
-    if (id == 0)
+    if (_poll_slab.find(*this)) {
+        delete_node(slot());
+    }
+}
+
+void Poll::park() const {
+    if (_poll_slab.find(*this)) {
+        _poll_slab.park(slot());
+    }
+}
+
+void Poll::wake() const {
+    if (_poll_slab.find(*this)) {
+        _poll_slab.wake(slot());
+    }
+}
+
+static u32 _waker_gen = 0;
+
+void Waker::add(Poll p) {
+    auto node = _poll_slab.find(p);
+    if (!node)
         return;
-    for (auto &item : _poll_list) {
-        if (item._id == this->id) {
-            item._flags |= PF_DELETE;
-            return;
-        }
+    // 每张等待表有全局唯一的代号, 节点已登记在本表时直接返回.
+    // 节点先后登记到多个Waker时可能在某张表中重复出现, 多余的唤醒无害
+    if (_gen == 0) {
+        if (++_waker_gen == 0)
+            ++_waker_gen;
+        _gen = _waker_gen;
     }
+    if (node->_waker == _gen)
+        return;
+    node->_waker = _gen;
+    // 等待者被删除而一直没有唤醒时, 失效句柄按表长翻倍的节奏清理
+    if (_polls.size() >= _prune_at) {
+        u32 n = 0;
+        for (auto &q : _polls)
+            if (q.is_active())
+                _polls[n++] = q;
+        _polls.resize(n);
+        _prune_at = n * 2 > 8 ? n * 2 : 8;
+    }
+    _polls.push_back(p);
 }
 
-void poll() {
-    while (1) {
-        // 检查并执行回调
-        for (auto it = _poll_list.begin(); it != _poll_list.end();) {
-            auto &item = *it;
-            // 删除标记的回调
-            if (item._flags & PF_DELETE) {
-                it = _poll_list.erase(it);
+void Waker::wake() {
+    if (_polls.empty())
+        return;
+    auto polls = std::move(_polls);
+    _polls.clear();
+    _gen = 0;
+    _prune_at = 8;
+    for (auto &p : polls)
+        p.wake();
+}
+
+Poll set_timer(u32 ms, u32 interval, PollFunc_1 cb) {
+    Poll p = _poll_slab.alloc(_current_task, PF_TIMER, std::move(cb));
+    auto node = _poll_slab.find(p);
+    node->_expire = get_tick_ms() + ms;
+    node->_interval = interval;
+    _timer_wheel.add(p.slot());
+    return p;
+}
+
+Poll set_timer(u32 ms, u32 interval, PollFunc cb) {
+    return set_timer(ms, interval, [cb = std::move(cb)](Poll) { cb(); });
+}
+
+// 投递队列: 有界, 无锁, 多生产者单消费者 (Vyukov有界队列)
+// 生产者可以是中断或其他线程, 只做一次CAS和一次发布, 不分配内存, 队列满时丢弃并计数.
+// 消费者是轮询循环, 每轮开始时取出全部已发布的条目执行.
+class PostQueue {
+public:
+    static constexpr u32 SIZE = POLL_POST_QUEUE_SIZE;
+    static constexpr u32 MASK = SIZE - 1;
+    static_assert((SIZE & MASK) == 0, "POLL_POST_QUEUE_SIZE must be a power of 2");
+
+    PostQueue() {
+        for (u32 i = 0; i < SIZE; ++i)
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(PostFunc fn, void *arg, IdType wake_id) {
+        u32 pos = _enqueue_pos.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &_cells[pos & MASK];
+            u32 seq = cell->seq.load(std::memory_order_acquire);
+            s32 diff = (s32)(seq - pos);
+            if (diff == 0) {
+                if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                // 满
+                _overflows.fetch_add(1, std::memory_order_relaxed);
+                return false;
             } else {
-                _current_task = item._task;
-                item._cb();
-                _current_task = nullptr;
+                pos = _enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->fn = fn;
+        cell->arg = arg;
+        cell->wake_id = wake_id;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        _posts.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
 
-                // 如果是一次性回调, 则标记删除
-                if (item._flags & PF_ONCE) {
-                    item._flags |= PF_DELETE;
-                }
+    bool has_pending() const {
+        const Cell &cell = _cells[_dequeue_pos & MASK];
+        return cell.seq.load(std::memory_order_acquire) == _dequeue_pos + 1;
+    }
+
+    // 仅由轮询循环调用, 返回执行的条目数.
+    // 只执行进入时已投递的条目, 执行期间新投递的留到下一轮, 持续投递不会让循环停在这里
+    u32 drain() {
+        u32 end = _enqueue_pos.load(std::memory_order_acquire);
+        u32 n = 0;
+        while (_dequeue_pos != end && has_pending()) {
+            Cell &cell = _cells[_dequeue_pos & MASK];
+            PostFunc fn = cell.fn;
+            void *arg = cell.arg;
+            IdType wake_id = cell.wake_id;
+            cell.seq.store(_dequeue_pos + SIZE, std::memory_order_release);
+            _dequeue_pos++;
+            if (fn)
+                fn(arg);
+            else
+                Poll(wake_id).wake();
+            n++;
+        }
+        return n;
+    }
 
-                ++it;
+    u32 posts() const { return _posts.load(std::memory_order_relaxed); }
+    u32 overflows() const { return _overflows.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell {
+        std::atomic<u32> seq;
+        PostFunc fn;
+        void *arg;
+        IdType wake_id;
+    };
+    Cell _cells[SIZE];
+    std::atomic<u32> _enqueue_pos{0};
+    u32 _dequeue_pos = 0;
+    std::atomic<u32> _posts{0};
+    std::atomic<u32> _overflows{0};
+};
+
+static PostQueue _post_queue;
+
+#ifdef _QT
+static void default_idle_hook(u32) {}
+static void notify_idle() {}
+#elif defined(_STM32)
+static void default_idle_hook(u32) {
+    // 等待中断, SysTick或外设中断会唤醒
+    __WFI();
+}
+static void notify_idle() {}
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+// 自管道: 其他线程投递时写入一个字节, 打断空闲等待
+static int _wake_pipe[2] = {-1, -1};
+static std::atomic<bool> _sleeping{false};
+
+static void default_idle_hook(u32 ms) {
+    if (_wake_pipe[0] < 0) {
+        if (pipe(_wake_pipe) != 0)
+            return;
+        fcntl(_wake_pipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(_wake_pipe[1], F_SETFL, O_NONBLOCK);
+    }
+    // 单次最多休眠100ms, 以便及时响应外部输入
+    if (ms > 100)
+        ms = 100;
+    // 先置休眠标志再检查队列, 与notify_idle先入队再读标志配对; 两边的全序栅栏保证
+    // 至少一方看到对方的写入, 不会出现队列有数据却睡满ms的情况
+    _sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!_post_queue.has_pending()) {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(_wake_pipe[0], &fds);
+        struct timeval tv = {(time_t)(ms / 1000), (suseconds_t)(ms % 1000) * 1000};
+        if (select(_wake_pipe[0] + 1, &fds, nullptr, nullptr, &tv) > 0) {
+            char buf[16];
+            while (read(_wake_pipe[0], buf, sizeof(buf)) > 0) {
             }
         }
     }
+    _sleeping.store(false);
 }
 
-static bool terminal_task_by_id(IdType task_id) {
-    bool res = false;
-    for (auto &item : _poll_list) {
-        if (item._task->task_id() == task_id) {
-            item._flags |= PF_DELETE;
-            res = true;
+// 在入队之后调用
+static void notify_idle() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // 每次休眠只需一个生产者写管道
+    if (_sleeping.exchange(false) && _wake_pipe[1] >= 0) {
+        char c = 0;
+        (void)!write(_wake_pipe[1], &c, 1);
+    }
+}
+#endif
+
+bool post(PostFunc fn, void *arg) {
+    if (!_post_queue.push(fn, arg, 0))
+        return false;
+    notify_idle();
+    return true;
+}
+
+bool post_wake(Poll p) {
+    if (!_post_queue.push(nullptr, nullptr, p.id))
+        return false;
+    notify_idle();
+    return true;
+}
+
+static IdleFunc _idle_hook = default_idle_hook;
+static PollStats _poll_stats = {};
+static u32 _stats_start = 0;
+static u32 _idle_start = 0;
+static bool _idling = false;
+
+void set_idle_hook(const IdleFunc &hook) {
+    _idle_hook = hook ? hook : IdleFunc(default_idle_hook);
+}
+
+const IdleFunc &get_idle_hook() {
+    return _idle_hook;
+}
+
+const PollStats &get_poll_stats() {
+    _poll_stats.posts = _post_queue.posts();
+    _poll_stats.post_overflows = _post_queue.overflows();
+    _poll_stats.nodes = _poll_slab.count();
+    _poll_stats.node_slots = _poll_slab.size();
+    return _poll_stats;
+}
+
+// 执行到期的定时器, 周期定时器重新挂入时间轮
+static void fire_timer(u32 slot, u32 now) {
+    auto &item = _poll_slab.at(slot);
+    if (item._flags & PF_DELETE)
+        return;
+    _poll_slab.set_running(slot);
+    _current_task = item._task;
+    item._cb(Poll::make(slot, item._gen));
+    _current_task = nullptr;
+    _poll_slab.set_running(PollSlab::NIL);
+    if (item._flags & PF_DELETE) {
+        _poll_slab.enqueue(slot, PollSlab::Q_DEAD);
+    } else if (item._interval) {
+        item._expire = now + item._interval;
+        _timer_wheel.add(slot);
+    } else {
+        delete_node(slot);
+    }
+}
+
+// 更新统计, 上一轮进入了空闲则到now为止空闲结束
+static void update_stats(u32 now) {
+    if (_poll_stats.loops == 0)
+        return;
+    if (_idling) {
+        _poll_stats.idle_ms += now - _idle_start;
+        _idling = false;
+    }
+    _poll_stats.busy_ms = (now - _stats_start) - _poll_stats.idle_ms;
+}
+
+// 执行一轮: 投递的任务, 到期的定时器, 就绪的节点. now为本轮开始时读取的时钟
+static void run_pass(u32 now, RunResult &r) {
+    if (_poll_stats.loops++ == 0)
+        _stats_start = now;
+    update_stats(now);
+    r.iterations++;
+
+    // 执行中断/其他线程投递的任务
+    r.work += _post_queue.drain();
+
+    _timer_wheel.advance(now, [now, &r](u32 slot) {
+        fire_timer(slot, now);
+        r.work++;
+    });
+
+    // 执行本轮就绪的节点, 本轮中新增或被唤醒的节点在下一轮执行
+    _poll_slab.splice(PollSlab::Q_READY, PollSlab::Q_CURRENT);
+    u32 i;
+    while ((i = _poll_slab.pop(PollSlab::Q_CURRENT)) != PollSlab::NIL) {
+        auto &item = _poll_slab.at(i);
+        _poll_slab.set_running(i);
+        _current_task = item._task;
+        item._cb(Poll::make(i, item._gen));
+        _current_task = nullptr;
+        _poll_slab.set_running(PollSlab::NIL);
+        r.work++;
+
+        if (item._flags & PF_DELETE) {
+            _poll_slab.enqueue(i, PollSlab::Q_DEAD);
+        } else if (item._flags & PF_ONCE) {
+            // 如果是一次性回调, 则标记删除
+            delete_node(i);
+        } else if ((item._flags & PF_WAIT) == 0) {
+            // 轮询节点继续留在就绪队列
+            _poll_slab.enqueue(i, PollSlab::Q_READY);
         }
     }
-    return res;
+    release_dead();
+}
+
+// 没有就绪的节点时休眠到最近的定时器到期, 最长max_ms. now须在本轮执行之后读取,
+// 否则休眠时间多出一轮的耗时, 这段耗时也会被计为空闲
+static void run_idle(u32 now, u32 max_ms) {
+    if (!_poll_slab.is_empty(PollSlab::Q_READY) || _post_queue.has_pending())
+        return;
+    u32 expire;
+    u32 ms = POLL_IDLE_FOREVER;
+    if (_timer_wheel.next_expire(expire))
+        ms = tick_diff(expire, now) > 0 ? expire - now : 0;
+    if (ms > max_ms)
+        ms = max_ms;
+    _poll_stats.idles++;
+    _idle_start = now;
+    _idling = true;
+    _idle_hook(ms);
+}
+
+RunResult run_once() {
+    RunResult r = {};
+    run_pass(get_tick_ms(), r);
+    return r;
+}
+
+RunResult run_for(u32 ms) {
+    RunResult r = {};
+    u32 start = get_tick_ms();
+    u32 now = start;
+    while (1) {
+        // 到达截止时间的一轮也执行, 截止时刻到期的定时器不会遗漏
+        run_pass(now, r);
+        if (now - start >= ms)
+            break;
+        now = get_tick_ms();
+        if (now - start < ms)
+            run_idle(now, ms - (now - start));
+        now = get_tick_ms();
+    }
+    update_stats(now);
+    return r;
+}
+
+RunResult run_until(InplaceFunc<bool()> pred) {
+    RunResult r = {};
+    u32 now = get_tick_ms();
+    bool done = pred();
+    while (!done) {
+        run_pass(now, r);
+        done = pred();
+        if (!done)
+            run_idle(get_tick_ms(), POLL_IDLE_FOREVER);
+        now = get_tick_ms();
+    }
+    update_stats(now);
+    return r;
+}
+
+void poll() {
+    run_until([] { return false; });
+}
+
+static bool terminal_task_by_id(IdType task_id) {
+    auto task = get_task(task_id);
+    if (task == nullptr)
+        return false;
+    task->terminal();
+    return true;
 }
 
 void _set_poll_thread(Shared<Task> task) {
-    auto id = new_id();
-    Poll main_poll{id};
-    _poll_list.push_back(PollNode(task, id, 0, [task, main_poll]{
+    Poll main_poll = _poll_slab.alloc(task, PF_MAIN, [task](Poll main_poll) {
         // check poll once
         if (task->_run == false) {
             task->_run = true;
-            task->init();
-        }else {
-            // check sub polls
-            for (auto &item : _poll_list) {
-                if (item._task->_task_id == task->_task_id) {
-                    if (item._task->_task_id == item._id) {
-                        // 跳过主节点, 主节点仅仅用于监视活动的子节点
-                        continue;
-                    }
-                    if ((item._flags & PF_DELETE) == 0) {
-                        // 存在活动的子节点, 则继续轮训
-                        return;
-                    }
-                }
-            }
-
-            // 没有活动的子节点, 则删除主节点, 主节点绑定了thread指针, 将被释放
-            main_poll.remove();
-            task->_run = false;
+            if (!task->_cancelled)
+                task->init();
         }
-    }));
-    task->_task_id = id;
+        if (task->_poll_live == 0) {
+            // 没有活动的子节点, 任务退出
+            _poll_slab.retire(task.get());
+        } else {
+            // 存在活动的子节点, 挂起主节点, 直到最后一个子节点删除时被唤醒
+            main_poll.park();
+        }
+    });
+    task->_task_id = main_poll.id;
 }
 
-Task::Task() : _task_id(0), _name("noname"), _run(false), _deletors() {}
+Task::Task() : _task_id(0), _name("noname"), _run(false), _cancelled(false), _deletors(), _poll_head(0xffffffff), _poll_live(0), _frame_arena(nullptr) {}
 Task::~Task() {
     for(const auto& d: _deletors) {
         d();
     }
+    if (_frame_arena)
+        _frame_arena->release();
 }
 void Task::terminal() {
-    for (auto &item : _poll_list) {
-        if (item._task->_task_id == this->_task_id) {
-            if (item._task->_task_id == item._id) {
-                // 忽略主节点, 只要删除线程的所有子节点, 他的主节点poll会终止自己
-                continue;
-            }
-            item._flags |= PF_DELETE;
-        }
-    }
+    _cancelled = true;
+    // 只要删除线程的所有子节点, 他的主节点会终止自己
+    _poll_slab.for_each_child(this, [](u32 slot, PollNode &) {
+        delete_node(slot);
+    });
+    // 沿任务组向下传播, 代价与子任务数成正比
+    for (auto group : _groups)
+        group->cancel();
 }
 bool Task::is_running() { return Poll(this->_task_id).is_active(); }
 
-void Task::install_deletor(const Func<void ()> &deletor)
+Task::DeletorId Task::install_deletor(const Func<void ()> &deletor)
 {
-    this->_deletors.push_back(deletor);
+    return this->_deletors.insert(this->_deletors.end(), deletor);
+}
+void Task::remove_deletor(DeletorId id) {
+    _deletors.erase(id);
+}
+void Task::use_frame_arena() {
+    if (_frame_arena == nullptr)
+        _frame_arena = new FramePool();
 }
 void start_task(Shared<Task> thread) {
     if(thread==nullptr)
@@ -196,20 +960,21 @@ void start_task(Shared<Task> thread) {
     _set_poll_thread(thread);
 }
 Shared<Task> get_task(IdType task_id) {
-    for (auto &item : _poll_list) {
-        if (item._task->task_id() == task_id) {
-            return item._task;
-        }
+    // 任务id即主节点句柄, 直接按槽位查找
+    auto node = _poll_slab.find(Poll(task_id));
+    if (node && node->_task && node->_task->task_id() == task_id) {
+        return node->_task;
     }
     return nullptr;
 }
 Shared<Task> get_task(const Str& name) {
-    for (auto &item : _poll_list) {
-        if (item._task->name() == name) {
-            return item._task;
+    Shared<Task> res = nullptr;
+    _poll_slab.for_each([&](Poll, PollNode &item) {
+        if (res == nullptr && (item._flags & PF_MAIN) && item._task->name() == name) {
+            res = item._task;
         }
-    }
-    return nullptr;
+    });
+    return res;
 }
 
 class _SimpleTask: public Task {
@@ -254,30 +1019,17 @@ void cmd_ps(Env e) {
     };
     
     List<TaskInfo> thread_info_list;
-    for(auto &item : _poll_list) {
-        if (item._task->task_id() == item._id) {
-            // main thread
-            auto it = std::find_if(thread_info_list.begin(), thread_info_list.end(),
-                                   [&](const auto &t) { return t._threadId == item._task->task_id(); });
-            if (it == thread_info_list.end()) {
-                thread_info_list.push_back({
-                    item._task->task_id(),
-                    1,
-                    item._flags,
-                    item._task->name()
-                });
-            }
-        }
-        else {
-            // sub thread
-            auto it = std::find_if(thread_info_list.begin(), thread_info_list.end(),
-                                   [&](const auto &t) { return t._threadId == item._task->task_id(); });
-            if (it != thread_info_list.end()) {
-                it->_pollIdCount++;
-                it->_flags |= item._flags;
-            }
-        }
-    }
+    // 遍历主节点, 各任务只统计自己的子节点
+    _poll_slab.for_each([&](Poll, PollNode &item) {
+        if ((item._flags & PF_MAIN) == 0)
+            return;
+        TaskInfo info = {item._task->task_id(), 1, item._flags & ~(PF_USED | PF_MAIN), item._task->name()};
+        _poll_slab.for_each_child(item._task.get(), [&](u32, PollNode &child) {
+            info._pollIdCount++;
+            info._flags |= child._flags & ~PF_USED;
+        });
+        thread_info_list.push_back(info);
+    });
 
     io.printf("%8s %6s %6s %s\n", "ThreadId", "Flags", "Polls", "NAME" );
     for (auto &item : thread_info_list) {
@@ -287,10 +1039,11 @@ void cmd_ps(Env e) {
     // 检查 -p 选项打印poll列表
     if (args.length() > 1 && args[1] == "-p") {
         io.printf("Poll List:\n");
-        for (auto &item : _poll_list) {
-            io.printf("ThreadId: %llu, PollId: %llu, Flags: %u, Name: %s\n", (unsigned long long)item._task->task_id(), 
-                    (unsigned long long)item._id, item._flags, item._task->name().c_str());
-        }
+        _poll_slab.for_each([&](Poll p, PollNode &item) {
+            io.printf("ThreadId: %llu, PollId: %llu, Flags: %u, Name: %s\n",
+                    (unsigned long long)(item._task ? item._task->task_id() : 0),
+                    (unsigned long long)p.id, item._flags & ~PF_USED, item._task ? item._task->name().c_str() : "-");
+        });
     }
     io.flush();
     e.exit(0);
@@ -303,7 +1056,7 @@ void cmd_kill(Env e) {
         io.printf("Usage: kill <thread_id>\n");
         return;
     }
-    IdType task_id = args[0].to_int();
+    IdType task_id = args[1].to_int64();
     if(terminal_task_by_id(task_id)) {
         io.printf("Thread %llu killed.\n", (unsigned long long)task_id);
     } else {
@@ -320,22 +1073,32 @@ void cmd_killall(Env e) {
         io.printf("Usage: killall <thread_name>\n");
         return;
     }
-    auto name = args[1];
-    for (auto &item : _poll_list) {
-        if (item._task->name() == name) {
-            if (item._task->task_id() == item._id) {
-                // 忽略主节点, 只要删除线程的所有子节点, 他的主节点poll会终止自己
-                continue;
-            }
-            item._flags |= PF_DELETE;
+    Str name = args[1];
+    _poll_slab.for_each([&](Poll, PollNode &item) {
+        if ((item._flags & PF_MAIN) && item._task->name() == name) {
+            item._task->terminal();
         }
-    }
+    });
+}
+
+void cmd_idle(Env e) {
+    auto& io = e.io();
+    auto& st = get_poll_stats();
+    u64 total = st.idle_ms + st.busy_ms;
+    io.printf("loops: %llu, idles: %llu\n", (unsigned long long)st.loops, (unsigned long long)st.idles);
+    io.printf("idle: %llu ms, busy: %llu ms, idle rate: %d%%\n", (unsigned long long)st.idle_ms,
+              (unsigned long long)st.busy_ms, total ? int(st.idle_ms * 100 / total) : 0);
+    io.printf("posts: %u, post overflows: %u\n", (unsigned)st.posts, (unsigned)st.post_overflows);
+    io.printf("nodes: %u, slots: %u\n", (unsigned)st.nodes, (unsigned)st.node_slots);
+    io.flush();
+    e.exit(0);
 }
 
 void _test_poll() {
+    printf("Test Poll\n");
     // 测试set_poll
     Shared<int> c = make_shared<int>(0);
-    set_poll([c](Poll pid) {
+    Poll counter = set_poll([c](Poll pid) {
         printf("Poll %llu: count: %d\n", (unsigned long long)pid.id, (*c)++);
         assert(pid.is_active() == true);
         if (*c == 5) {
@@ -344,11 +1107,139 @@ void _test_poll() {
             assert(pid.is_active() == false);
         }
     });
-    
+
     // 测试set_poll_once
-    set_once([] {
+    Shared<int> once = make_shared<int>(0);
+    set_once([once] {
         printf("Poll once\n");
+        (*once)++;
+    });
+
+    // 测试run_once: 每轮每个就绪节点执行一次
+    RunResult r = run_once();
+    assert(r.iterations == 1 && r.work == 2);
+    assert(*c == 1 && *once == 1);
+
+    // 测试run_until: 条件满足后立即返回
+    r = run_until([c] { return *c == 5; });
+    assert(r.iterations == 4 && r.work == 4);
+    assert(counter.is_active() == false && *once == 1);
+    r = run_until([] { return true; });
+    assert(r.iterations == 0 && r.work == 0);
+
+    // 测试挂起/唤醒: 挂起的节点不执行, 唤醒后下一轮执行
+    Shared<int> woken = make_shared<int>(0);
+    Poll parked = set_poll([woken](Poll p) {
+        (*woken)++;
+        p.park();
+    });
+    run_once();
+    run_once();
+    assert(*woken == 1 && run_once().work == 0);
+    parked.wake();
+    assert(run_once().work == 1 && *woken == 2);
+    parked.remove();
+
+    // 测试Waker: 重复登记只记一次, 失效句柄在登记时均摊清理, 复用槽位的新节点正常登记
+    {
+        Waker w;
+        Vec<Poll> waiters;
+        for (int i = 0; i < 16; i++)
+            waiters.push_back(set_poll([](Poll p) { p.park(); }));
+        run_once();
+        for (int k = 0; k < 2; k++)
+            for (auto &p : waiters)
+                w.add(p);
+        assert(w.size() == 16);
+        for (auto &p : waiters)
+            p.remove();
+        run_once();
+        Shared<int> runs = make_shared<int>(0);
+        Poll fresh = set_poll([runs](Poll p) {
+            (*runs)++;
+            p.park();
+        });
+        run_once();
+        assert(*runs == 1);
+        w.add(fresh);
+        assert(w.size() == 1);
+        w.wake();
+        assert(w.is_empty());
+        run_once();
+        assert(*runs == 2);
+        fresh.remove();
+    }
+
+    // 测试run_for: 没有就绪节点时休眠到期返回
+    u32 start = get_tick_ms();
+    r = run_for(20);
+    assert(get_tick_ms() - start >= 20 && r.work == 0);
+
+    // 测试任务: 存在子节点时任务保持运行, 最后一个子节点删除后退出
+    Poll child;
+    auto task = start_task([&child](Task *) {
+        child = set_timeout(10, [] {});
     });
+    run_once();
+    assert(task->is_running() && child.is_active());
+    run_until([task] { return !task->is_running(); });
+    assert(!child.is_active());
+
+    // 测试定时器回调中重新设置的0ms定时器: 每轮只执行一次, 不在同一轮中反复触发
+    struct Rearm {
+        int *fired;
+        bool *stop;
+        void operator()() const {
+            ++*fired;
+            if (!*stop)
+                set_timeout(0, Rearm{fired, stop});
+        }
+    };
+    for (int pass = 0; pass < 2; ++pass) {
+        pass == 0 ? use_virtual_clock() : use_system_clock();
+        int fired = 0;
+        bool stop = false;
+        set_timeout(0, Rearm{&fired, &stop});
+        run_once();
+        fired = 0;
+        for (int n = 1; n <= 5; ++n) {
+            run_once();
+            assert(fired == n);
+        }
+        stop = true;
+        run_once();
+        assert(fired == 6 && run_once().work == 0);
+    }
+
+    // 测试投递: 执行中再次投递的条目留到下一轮
+    struct Repost {
+        static void run(void *arg) {
+            int *count = static_cast<int *>(arg);
+            if (++*count < 3)
+                post(run, arg);
+        }
+    };
+    int posted = 0;
+    post(Repost::run, &posted);
+    for (int n = 1; n <= 3; ++n) {
+        run_once();
+        assert(posted == n);
+    }
+
+    // 测试句柄代数: 槽位回收复用后旧句柄失效
+    Poll old = set_poll([] {});
+    u32 slot = old.slot();
+    old.remove();
+    release_dead();
+    assert(old.is_active() == false);
+    Poll reuse = set_poll([] {});
+    assert(reuse.slot() == slot && reuse.generation() == old.generation() + 1);
+    assert(reuse.is_active() == true);
+    old.remove(); // 旧句柄不能删除新节点
+    assert(reuse.is_active() == true);
+    reuse.remove();
+    run_once();
+    printf("Test Poll PASS\n");
 }
 
 Shared<Task> get_current_task()
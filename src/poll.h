@@ -11,6 +11,8 @@
 
 using IdType = uint64_t;
 
+// Poll句柄: 低32位为注册表槽位号+1, 高32位为槽位代数(generation)
+// 槽位被回收复用后代数递增, 旧句柄自动失效
 struct Poll {
     IdType id = 0;
 public:
@@ -21,38 +23,132 @@ public:
         id = other.id;
         return *this;
     }
+    static Poll make(u32 slot, u32 gen) { return Poll{((IdType)gen << 32) | (IdType)(slot + 1)}; }
+    u32 slot() const { return (u32)id - 1; }
+    u32 generation() const { return (u32)(id >> 32); }
     bool is_null() const;
     bool is_not_null() const;
     void set_null();
     bool is_active() const;
     void remove() const;
+    // 挂起: 节点离开就绪队列, 回调不再每轮执行, 直到wake()
+    void park() const;
+    // 唤醒挂起的节点, 下一轮执行; 对未挂起或已删除的节点无效
+    void wake() const;
 };
-using PollFunc = Func<void()>;
-using PollFunc_1 = Func<void(Poll pid)>;
-extern Poll set_poll(const PollFunc &cb);
-extern Poll set_poll(const PollFunc_1 &cb);
-using OnceFunc = Func<void()>;
-extern void set_once(const OnceFunc& cb);
+
+// 唤醒器: 事件源登记等待它的挂起节点, 事件发生时全部唤醒
+// 典型用法: 回调中检查条件不满足时 waker.add(p); p.park();
+class Waker {
+    Vec<Poll> _polls;
+    u32 _gen = 0;      // 本次等待表的代号, 节点记下最近登记的代号, 重复登记O(1)判断
+    u32 _prune_at = 8; // 表长到达该值时清理失效句柄, 清理后翻倍, 均摊O(1)
+public:
+    void add(Poll p);
+    void wake();
+    bool is_empty() const { return _polls.empty(); }
+    // 登记的句柄数, 可能含已删除的节点
+    u32 size() const { return _polls.size(); }
+};
+
+// 节点回调容量, 默认比普通回调多留出一个Shared<>和若干值的空间, 便于Promise等再包一层
+#ifndef POLL_FUNC_SIZE
+#define POLL_FUNC_SIZE (FUNC_INPLACE_SIZE + 32)
+#endif
+// 回调为仅移动的InplaceFunc, 捕获不超过容量时注册节点不分配内存
+using PollFunc = InplaceFunc<void()>;
+using PollFunc_1 = InplaceFunc<void(Poll pid), POLL_FUNC_SIZE>;
+extern Poll set_poll(PollFunc cb);
+extern Poll set_poll(PollFunc_1 cb);
+// 定时器节点: 挂入调度器时间轮, ms后执行, interval非0时按周期重复执行
+extern Poll set_timer(u32 ms, u32 interval, PollFunc cb);
+extern Poll set_timer(u32 ms, u32 interval, PollFunc_1 cb);
+using OnceFunc = PollFunc;
+extern void set_once(OnceFunc cb);
+
+// 投递: 可在中断或其他线程中调用, 无锁且不分配内存, 轮询循环在下一轮开始时执行.
+// set_poll/set_once/wake等其他接口只能在轮询循环中调用. 队列满返回false并计入溢出次数.
+#ifndef POLL_POST_QUEUE_SIZE
+#define POLL_POST_QUEUE_SIZE 64
+#endif
+using PostFunc = void (*)(void *arg);
+extern bool post(PostFunc fn, void *arg);
+// 投递唤醒一个挂起的节点
+extern bool post_wake(Poll p);
+
+// 有界的循环入口, 便于嵌入宿主程序的主循环以及测试/基准测试
+struct RunResult {
+    u32 iterations; // 执行的轮数
+    u32 work;       // 执行的回调数(投递, 定时器, 轮询节点)
+};
+// 执行一轮, 不进入空闲
+extern RunResult run_once();
+// 循环执行ms毫秒, 期间没有就绪节点时进入空闲钩子
+extern RunResult run_for(u32 ms);
+// 循环执行直到pred()返回true, 每轮结束后检查
+extern RunResult run_until(InplaceFunc<bool()> pred);
+// 永久循环, 等价于run_until(false)
 extern void poll();
 
+// 空闲钩子: 一轮循环中没有回调执行时调用, ms为距最近定时器到期的时间
+// 默认实现: 主机上nanosleep, MCU上WFI
+constexpr u32 POLL_IDLE_FOREVER = 0xffffffff;
+using IdleFunc = Func<void(u32 ms)>;
+extern void set_idle_hook(const IdleFunc &hook);
+extern const IdleFunc &get_idle_hook();
+
+struct PollStats {
+    u64 loops;      // 循环次数
+    u64 idles;      // 进入空闲钩子的次数
+    u64 idle_ms;    // 空闲累计时间
+    u64 busy_ms;    // 忙碌累计时间
+    u32 posts;          // 投递次数
+    u32 post_overflows; // 投递队列满丢弃的次数
+    u32 nodes;          // 活动节点数
+    u32 node_slots;     // 节点槽位总数, 只增不减, 稳定运行时不再增长说明注册节点不分配内存
+};
+extern const PollStats &get_poll_stats();
+
 
+class PollSlab;
+class FramePool;
+class TaskGroup;
 class Task {
     IdType _task_id;
     Str _name;
     bool _run;
+    bool _cancelled;            // 已被terminal, 尚未启动的任务不再启动
     List<Func<void()>> _deletors;
+    u32 _poll_head;     // 子节点链表头(槽位号)
+    u32 _poll_live;     // 未标记删除的子节点数
+    Waker _exit_waker;
+    FramePool *_frame_arena;    // 协程帧独立分区, 未开启时为nullptr
+    Vec<TaskGroup *> _groups;   // 在本任务中创建的任务组, 任务被终止时一并取消
     friend void _set_poll_thread(Shared<Task> thread);
+    friend class PollSlab;
+    friend class TaskGroup;
 public:
     Task();
     virtual ~Task();
     Str name() const { return _name; }
     void set_name(const Str& name) { _name = name; }
     IdType task_id() const { return _task_id; }
+    // 终止任务: 删除全部子节点, 并取消本任务中创建的任务组的子任务(递归)
     void terminal();
     bool is_running();
-    void install_deletor(const Func<void()>& deletor);
+    // 任务结束时执行的清理函数, 返回的id可用于提前注销
+    using DeletorId = List<Func<void()>>::iterator;
+    DeletorId install_deletor(const Func<void()>& deletor);
+    void remove_deletor(DeletorId id);
+    // 开启协程帧独立分区: 之后本任务中创建的协程帧从任务自己的池分配, 任务结束时整体释放
+    void use_frame_arena();
+    FramePool *frame_arena() const { return _frame_arena; }
+    // 登记等待任务结束的节点, 任务结束时唤醒; 调用前应确认is_running()
+    void wait_exit(Poll p) { _exit_waker.add(p); }
 protected:
     virtual void init() {}
+    // 任务退出(主节点删除)时调用
+    virtual void exited() {}
 };
 extern void start_task(Shared<Task> thread);
 extern Shared<Task> start_task(const Func<void(Task*)>& cb);
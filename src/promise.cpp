@@ -3,6 +3,11 @@
 #include <poll.h>
 #include <timeout.h>
 #include <async.h>
+#include <frame_pool.h>
+#include <when.h>
+#include <stdio.h>
+#include <assert.h>
+#include <test_counted.h>
 
 static auto start_int_promise(int x) {
     return Promise<int>([x](auto resolve) { set_timeout(1000, [=] { resolve(x); }); });
@@ -38,3 +43,218 @@ void cmd_test_promise(Env e) {
         });
     }
 }
+
+#if __cplusplus >= 202002L
+
+static Async<void> await_int(Promise<int> p, int *out) {
+    *out = *co_await p;
+}
+
+static Async<void> await_void(Promise<void> p, int *out) {
+    co_await p;
+    ++*out;
+}
+
+// 不可默认构造
+struct Reading {
+    int v;
+    explicit Reading(int v) : v(v) {}
+};
+
+static Async<void> await_counted(Promise<Counted>::ResolveFunc *resolve, int *value) {
+    Counted c = *co_await Promise<Counted>([resolve](auto r) { *resolve = r; });
+    *value = c.value;
+}
+
+// 等待可能被reject的Promise, 错误码记入out(负数), 成功时记入值
+static Async<void> await_settled(Promise<int> p, int *out) {
+    Settled<int> r = co_await p;
+    *out = r ? *r : -r.error.code;
+}
+
+static Async<void> await_void_settled(Promise<void> p, int *out) {
+    Settled<void> r = co_await p;
+    *out = r.ok() ? 1 : -r.error.code;
+}
+
+static Async<void> await_recovered(int *out) {
+    *out = *co_await Promise<int>([](auto r) { r.reject({3}); }).catch_([](const PromiseError &e) {
+        return -e.code;
+    });
+}
+
+void _test_promise() {
+    printf("Test Promise\n");
+    use_virtual_clock();
+
+    // 等待期间延续不执行, resolve后每个延续只执行一次
+    Promise<int>::ResolveFunc resolve_int;
+    Promise<void>::ResolveFunc resolve_void;
+    Promise<int> pi([&resolve_int](auto resolve) { resolve_int = resolve; });
+    Promise<void> pv([&resolve_void](auto resolve) { resolve_void = resolve; });
+    int then_calls = 0, awaited = 0, void_calls = 0;
+    pi.then([&then_calls](int x) { then_calls += x; });
+    pv.then_([&void_calls] { void_calls++; });
+    start_task_async([&](Task *) { return await_int(pi, &awaited); });
+    start_task_async([&](Task *) { return await_void(pv, &void_calls); });
+    run_once();
+    RunResult r = run_for(5000);
+    assert(r.work == 0);
+    assert(then_calls == 0 && awaited == 0 && void_calls == 0);
+    resolve_int(7);
+    resolve_void();
+    r = run_once();
+    assert(then_calls == 7 && awaited == 7 && void_calls == 2);
+    assert(r.work == 4);
+    run_once();
+    r = run_for(100);
+    assert(r.work == 0 && then_calls == 7);
+
+    // 已resolve时直接取结果, 不挂起
+    awaited = 0;
+    start_task_async([&](Task *) { return await_int(pi, &awaited); });
+    run_once();
+    assert(awaited == 7);
+
+    // 任务终止后延续取消, resolve不会恢复已销毁的协程
+    int late = 0;
+    Promise<int>::ResolveFunc resolve_late;
+    Promise<int> pl([&resolve_late](auto resolve) { resolve_late = resolve; });
+    auto task = start_task_async([&](Task *) { return await_int(pl, &late); });
+    run_once();
+    task->terminal();
+    task = nullptr;
+    run_once();
+    resolve_late(1);
+    run_for(10);
+    assert(late == 0);
+    assert(get_frame_stats().live == 0);
+
+    // promise_all在子Promise的resolve中同步汇合
+    int all = 0;
+    promise_all(pi, pv).then([&all](auto res) { all = res._0(); });
+    run_once();
+    assert(all == 7);
+    // 子Promise的句柄释放后组合仍然等到它们完成
+    all = 0;
+    {
+        auto p1 = Promise<int>([](auto r) { set_timeout(10, [=] { r(9); }); });
+        auto p2 = Promise<void>([](auto r) { set_timeout(20, [=] { r(); }); });
+        promise_all(p1, p2).then([&all](auto res) { all = res._0(); });
+    }
+    run_for(30);
+    assert(all == 9);
+
+    // 链式then: 结果沿链移动不复制, 返回的Promise被展开
+    Counted::reset();
+    Promise<Counted>::ResolveFunc resolve_counted;
+    int value = 0;
+    Promise<Counted>([&resolve_counted](auto r) { resolve_counted = r; })
+        .then([](Counted c) {
+            c.value++;
+            return c;
+        })
+        .then([](Counted &&c) {
+            return Promise<int>([n = c.value](auto r) { set_timeout(10, [=] { r(n); }); });
+        })
+        .then([&value](int n) { value = n; });
+    resolve_counted(Counted(100));
+    run_for(20);
+    assert(value == 101 && Counted::copies == 0);
+
+    // 仅移动的, 不可默认构造的结果
+    int doubled = 0;
+    Promise<Unique<int>>([](auto r) { r(make_unique<int>(5)); })
+        .then([](Unique<int> p) { return Reading(*p * 2); })
+        .then([&doubled](const Reading &r) { doubled = r.v; });
+    run_for(10);
+    assert(doubled == 10);
+
+    // 有多个持有者时传引用, 结果保留在共享状态中
+    Promise<Counted> shared([](auto r) { r(Counted(8)); });
+    int seen_a = 0, seen_b = 0;
+    shared.then([&seen_a](const Counted &c) { seen_a = c.value; });
+    shared.then([&seen_b](const Counted &c) { seen_b = c.value; });
+    run_for(10);
+    assert(seen_a == 8 && seen_b == 8 && shared.result().value == 8 && Counted::copies == 0);
+
+    // reject跳过then, 由catch_恢复, finally总是执行; 只有第一次完成有效
+    Promise<int>::ResolveFunc resolve_fail;
+    int skipped = 0, recovered = 0, finals = 0;
+    PromiseError caught;
+    Promise<int>([&resolve_fail](auto r) { resolve_fail = r; })
+        .then([&skipped](int v) {
+            skipped++;
+            return v;
+        })
+        .catch_([&caught](const PromiseError &e) {
+            caught = e;
+            return -1;
+        })
+        .finally([&finals] { finals++; })
+        .then([&recovered](int v) { recovered = v; });
+    resolve_fail.reject({5, "io"});
+    resolve_fail(1);
+    run_for(10);
+    assert(skipped == 0 && caught.code == 5 && recovered == -1 && finals == 1);
+    int void_caught = 0, void_after = 0;
+    Promise<void>([](auto r) { r.reject({1}); })
+        .catch_([&void_caught](const PromiseError &) { void_caught++; })
+        .then([&void_after] { void_after++; });
+    run_for(10);
+    assert(void_caught == 1 && void_after == 1);
+
+    // 协程等待临时Promise时结果移动出来; 也可以先catch_转换错误再等待
+    value = 0;
+    start_task_async([&](Task *) { return await_counted(&resolve_counted, &value); });
+    run_once();
+    resolve_counted(Counted(16));
+    run_for(10);
+    assert(value == 16 && Counted::copies == 0);
+    int out = 0;
+    start_task_async([&out](Task *) { return await_recovered(&out); });
+    run_for(10);
+    assert(out == -3);
+
+    // 等待被reject的Promise: 错误交给等待者, 已经reject的和等待中reject的都一样
+    int rejected_now = 0, rejected_later = 0, void_rejected = 0, fulfilled = 0;
+    Promise<int>::ResolveFunc reject_later;
+    Promise<void>::ResolveFunc reject_void;
+    start_task_async([&](Task *) {
+        return await_settled(Promise<int>([](auto r) { r.reject({5}); }), &rejected_now);
+    });
+    start_task_async([&](Task *) {
+        return await_settled(Promise<int>([&reject_later](auto r) { reject_later = r; }), &rejected_later);
+    });
+    start_task_async([&](Task *) {
+        return await_void_settled(Promise<void>([&reject_void](auto r) { reject_void = r; }), &void_rejected);
+    });
+    start_task_async([&](Task *) { return await_settled(Promise<int>([](auto r) { r(8); }), &fulfilled); });
+    run_once();
+    assert(rejected_now == -5 && fulfilled == 8 && rejected_later == 0);
+    reject_later.reject({6});
+    reject_void.reject({7});
+    run_for(10);
+    assert(rejected_later == -6 && void_rejected == -7);
+
+    // 组合: when_all在任一个reject时reject, race取最先完成的一个
+    Vec<Promise<int>::ResolveFunc> resolvers(3);
+    Vec<Promise<int>> group;
+    for (int i = 0; i < 3; ++i)
+        group.push_back(Promise<int>([&resolvers, i](auto r) { resolvers[i] = r; }));
+    int all_code = 0, race_code = 0;
+    when_all(group).catch_([&all_code](const PromiseError &e) {
+        all_code = e.code;
+        return Vec<int>();
+    });
+    race(group).catch_([&race_code](const PromiseError &e) { return race_code = e.code; });
+    resolvers[1].reject({7});
+    resolvers[0](1);
+    run_for(10);
+    assert(all_code == 7 && race_code == 7);
+    assert(get_frame_stats().live == 0);
+    use_system_clock();
+    printf("Test Promise PASS\n");
+}
+
+#endif // __cplusplus >= 202002L
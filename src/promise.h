@@ -3,131 +3,404 @@
 
 #include <poll.h>
 #include <types.h>
+#include <rc.h>
+#include <assert.h>
 
 #if __cplusplus >= 202002L
 #include <coroutine>
 #endif
 
+// reject的原因
+struct PromiseError {
+    int code = 0;
+    const char *what = "";
+};
+
+// co_await promise的结果: fulfill时持有值, reject时ok()为false, 原因在error中.
+// 用*r或r->取值, 值不要求可默认构造; 等待临时的结果时*co_await p直接移动出值
+template <typename T> struct Settled {
+    Optional<T> value;
+    PromiseError error;
+    bool ok() const { return value.has_value(); }
+    explicit operator bool() const { return ok(); }
+    T &operator*() & {
+        assert(ok());
+        return *value;
+    }
+    const T &operator*() const & {
+        assert(ok());
+        return *value;
+    }
+    T &&operator*() && {
+        assert(ok());
+        return std::move(*value);
+    }
+    T *operator->() {
+        assert(ok());
+        return &*value;
+    }
+};
+template <> struct Settled<void> {
+    bool rejected = false;
+    PromiseError error;
+    bool ok() const { return !rejected; }
+    explicit operator bool() const { return ok(); }
+};
+
+template <typename T> class Promise;
+template <typename T> struct _IsPromise : std::false_type {};
+template <typename T> struct _IsPromise<Promise<T>> : std::true_type {};
+// then回调返回R时链上的下一个Promise: 返回Promise<V>时展开为Promise<V>
+template <typename R> struct _PromiseChain {
+    using Type = Promise<R>;
+};
+template <typename V> struct _PromiseChain<Promise<V>> {
+    using Type = Promise<V>;
+};
+
+// 延续(then/catch_/finally/co_await)是挂起在共享状态上的节点, 等待期间不占用轮询;
+// 完成时唤醒它们, 每个延续在下一轮执行恰好一次. 节点属于登记时的任务, 任务终止时延续随之取消.
+// 结果沿链移动: 延续执行时如果只有它还持有共享状态(链上的临时Promise都已释放), 结果直接移动给回调,
+// 否则传引用或复制; 仅移动的类型总是移动, 只能交给一个消费者.
 template <typename T> class Promise {
+    template <typename> friend class Promise;
+
 public:
-    using Result = T;
+    // void的结果用char占位
+    using Result = std::conditional_t<std::is_void_v<T>, char, T>;
+    enum State : u8 { PENDING, FULFILLED, REJECTED };
+
+    // 共享状态, 连同引用计数从本类型的池中一次分配(见rc.h), 结果不要求可默认构造.
+    // Promise句柄和延续节点持有强引用, 解决器只持有弱引用, 都只有一个指针宽.
     struct Future {
-        Result result;
-        bool resolved = false;
-    };
-    using ResultFunc = Func<void(const Result &)>;
-    using ResolveFunc = Func<void(const Result &)>;
-
-    Promise(const Promise &p) : _future(p._future) {}
-    Promise(const Func<void(const ResolveFunc &)> &init) {
-        _future = std::make_shared<Future>();
-        auto weak_future = std::weak_ptr<Future>(_future);
-        ResolveFunc resolve_in_future = [weak_future](const Result &result) {
-            if (auto future = weak_future.lock()) {
-                future->result = result;
-                future->resolved = true;
-            }
+        State state = PENDING;
+        Optional<Result> value;
+        PromiseError error;
+        Poll waiter; // 通常只有一个延续, 直接放在状态中
+        // 不常用的部分用到时才分配: 其余的延续, 完成时同步调用的回调, 组合依赖的子Promise.
+        // 回调的last表示它是最后一个回调, 之后只有持有强引用的延续还会读取结果
+        struct Extra {
+            Waker waiters;
+            Vec<InplaceFunc<void(Future &, bool last), POLL_FUNC_SIZE>> listeners;
+            Vec<RcAny> deps; // 完成前保持子Promise存活
         };
-        init(resolve_in_future);
-    }
-    const Promise &then(const ResultFunc &result_cb) const {
-        Shared<Future> future = _future;
-        set_poll([future, result_cb](auto poll) {
-            if (future->resolved) {
-                result_cb(future->result);
-                poll.remove();
+        Unique<Extra> extra;
+
+        Extra &more() {
+            if (!extra)
+                extra = make_unique<Extra>();
+            return *extra;
+        }
+        bool is_settled() const { return state != PENDING; }
+        void add_waiter(Poll p) {
+            if (waiter.is_null() || !waiter.is_active())
+                waiter = p;
+            else
+                more().waiters.add(p);
+        }
+        // 只有第一次完成有效
+        template <typename... V> void fulfill(V &&...v) {
+            if (state != PENDING)
+                return;
+            value.emplace(std::forward<V>(v)...);
+            state = FULFILLED;
+            settle();
+        }
+        void reject(const PromiseError &e) {
+            if (state != PENDING)
+                return;
+            error = e;
+            state = REJECTED;
+            settle();
+        }
+        void settle() {
+            if (waiter.is_not_null()) {
+                Poll p = waiter;
+                waiter.set_null();
+                p.wake();
             }
-        });
-        return *this;
-    }
+            if (auto ex = std::move(extra)) {
+                ex->deps.clear();
+                size_t n = ex->listeners.size();
+                for (size_t i = 0; i < n; ++i)
+                    ex->listeners[i](*this, i + 1 == n);
+                ex->waiters.wake();
+            }
+        }
+    };
 
-#if __cplusplus >= 202002L
-    // 协程中支持等待Promise
-    auto operator co_await() {
-        struct Awaiter {
-            Promise<T> _promise;
-            T _result = T();
-            bool await_ready() const {
-                return _promise._future->resolved;
+    // 解决器: 可以复制传递; Promise的句柄和延续都已释放时调用无效
+    class Resolver {
+        RcWeak<Future> _future;
+
+    public:
+        Resolver() = default;
+        explicit Resolver(const Rc<Future> &f) : _future(f) {}
+        void operator()(const Result &value) const {
+            if (auto f = _future.lock())
+                f->fulfill(value);
+        }
+        void operator()(Result &&value) const {
+            if (auto f = _future.lock())
+                f->fulfill(std::move(value));
+        }
+        void operator()() const {
+            static_assert(std::is_void_v<T>, "resolve() without a value is only for Promise<void>");
+            if (auto f = _future.lock())
+                f->fulfill();
+        }
+        void reject(const PromiseError &e) const {
+            if (auto f = _future.lock())
+                f->reject(e);
+        }
+        // 完成前保持子Promise存活, 组合只通过listen挂在子Promise上, 调用者可以不再持有它们
+        template <typename U> void depend_on(const Promise<U> &p) const {
+            auto f = _future.lock();
+            if (f && !f->is_settled() && !p.is_settled())
+                f->more().deps.push_back(RcAny(p._future));
+        }
+        // p fulfill时同步调用cb(value), value是右值, 与depend_on(p)配合用于组合收集子Promise的结果;
+        // 本Promise已完成或已释放时不再调用. p只被完成它的一方和组合的依赖持有(调用者已释放句柄),
+        // 且cb是p上最后一个回调时结果直接移动给cb, 否则复制; 仅移动的类型总是移动.
+        // 组合应在登记其余回调之后调用collect
+        template <typename U, typename F> void collect(const Promise<U> &p, F &&cb) const {
+            using Child = typename Promise<U>::Future;
+            if (p.is_settled()) {
+                auto f = _future.lock();
+                if (p.is_resolved() && f && !f->is_settled())
+                    _take(*p._future, false, cb);
+                return;
             }
-            void await_suspend(std::coroutine_handle<> awaiting) {
-                _promise.then([this, awaiting](const Result& result){
-                    _result = result;
-                    awaiting.resume();
+            p._future->more().listeners.push_back(
+                [cb = std::forward<F>(cb), parent = _future, child = RcWeak<Child>(p._future)](Child &f, bool last) mutable {
+                    auto owner = parent.lock();
+                    if (f.state != Promise<U>::FULFILLED || !owner || owner->is_settled())
+                        return;
+                    // 组合未完成时它的依赖还在, 再加上完成p的一方共两个强引用
+                    _take(f, last && child.use_count() == 2, cb);
                 });
+        }
+
+    private:
+        template <typename Child, typename F> static void _take(Child &f, bool sole, F &cb) {
+            using V = std::decay_t<decltype(*f.value)>;
+            if constexpr (std::is_copy_constructible_v<V>) {
+                if (!sole) {
+                    cb(V(*f.value));
+                    return;
+                }
             }
-            T await_resume() {
-                return _result;
-            }
-        };
-        return Awaiter{*this};
+            cb(std::move(*f.value));
+        }
+    };
+    using ResolveFunc = Resolver;
+    using ResultFunc = InplaceFunc<void(const Result &)>;
+
+    // init(resolve)中启动异步操作, 完成时resolve(value)或resolve.reject(error)
+    template <typename Init, typename = std::enable_if_t<std::is_invocable_v<Init &, const Resolver &>>>
+    Promise(Init &&init) : _future(make_rc<Future>()) {
+        init(Resolver(_future));
     }
-#endif // C++20
+    Promise(const Promise &) = default;
+    Promise(Promise &&) noexcept = default;
+    Promise &operator=(const Promise &) = default;
+    Promise &operator=(Promise &&) noexcept = default;
 
-private:
-    Shared<Future> _future;
-};
+    // 完成后在下一轮调用cb(value), 返回cb结果的Promise; cb返回Promise时展开.
+    // 被reject时跳过cb, 错误传给返回的Promise. Promise<void>的cb不带参数(或带一个char占位)
+    template <typename F> auto then(F &&cb) const {
+        using Next = typename _PromiseChain<_Ret<std::decay_t<F>>>::Type;
+        auto next = make_rc<typename Next::Future>();
+        _continue([cb = std::forward<F>(cb), next](Future &src, bool sole) mutable {
+            if (src.state == REJECTED)
+                next->reject(src.error);
+            else
+                _settle_next<Next>(next, [&] { return _call(cb, src, sole); });
+        });
+        return Next(next);
+    }
+    template <typename F> auto then_(F &&cb) const { return then(std::forward<F>(cb)); }
 
-template <> class Promise<void> {
-public:
-    using Result = char;
-    using ResolveFunc = Func<void()>;
-    using ResultFunc = Func<void(char)>;
-    using VoidResultFunc = Func<void()>;
-
-    Promise(const Promise &p) : _is_resolved(p._is_resolved) {}
-    Promise(const Func<void(const ResolveFunc &)> &init) {
-        _is_resolved = std::make_shared<bool>(false);
-        auto weak_is_resolved = std::weak_ptr<bool>(_is_resolved);
-        ResolveFunc resolve_in_future = [weak_is_resolved] {
-            if (auto is_resolved = weak_is_resolved.lock()) {
-                *is_resolved = true;
-            }
-        };
-        init(resolve_in_future);
-    }
-    const Promise &then(const ResultFunc &result_cb) const {
-        Shared<bool> is_resolved = _is_resolved;
-        set_poll([is_resolved, result_cb](auto poll) {
-            if (*is_resolved) {
-                result_cb(char{});
-                poll.remove();
-            }
+    // 被reject时调用cb(error)恢复, cb返回T(Promise<void>时不返回)或Promise<T>; 已fulfill时结果原样传下去
+    template <typename F> Promise catch_(F &&cb) const {
+        using R = std::invoke_result_t<std::decay_t<F> &, const PromiseError &>;
+        static_assert(std::is_same_v<typename _PromiseChain<R>::Type, Promise> || std::is_convertible_v<R, Result>,
+                      "catch_ callback must return the promise's value type or a Promise of it");
+        auto next = make_rc<Future>();
+        _continue([cb = std::forward<F>(cb), next](Future &src, bool sole) mutable {
+            if (src.state == FULFILLED)
+                _forward(src, sole, *next);
+            else
+                _settle_next<Promise>(next, [&] { return cb(std::as_const(src.error)); });
         });
-        return *this;
+        return Promise(next);
     }
-    const Promise &then_(const VoidResultFunc &result_cb) const {
-        Shared<bool> is_resolved = _is_resolved;
-        set_poll([is_resolved, result_cb](auto poll) {
-            if (*is_resolved) {
-                result_cb();
-                poll.remove();
-            }
+
+    // 无论结果如何都调用cb(), 结果原样传下去
+    template <typename F> Promise finally(F &&cb) const {
+        auto next = make_rc<Future>();
+        _continue([cb = std::forward<F>(cb), next](Future &src, bool sole) mutable {
+            cb();
+            _forward(src, sole, *next);
+        });
+        return Promise(next);
+    }
+
+    // 在resolve中同步调用回调, 不占用轮询节点, 已resolve时立即调用.
+    // 回调中不要做耗时的工作, 用于when_all等组合在子Promise完成时只做计数
+    template <typename F> const Promise &listen(F &&cb) const {
+        return on_settle([cb = std::forward<F>(cb)](const Future &f) mutable {
+            if (f.state == FULFILLED)
+                cb(*f.value);
+        });
+    }
+    template <typename F> const Promise &listen_(F &&cb) const {
+        return on_settle([cb = std::forward<F>(cb)](const Future &f) mutable {
+            if (f.state == FULFILLED)
+                cb();
         });
+    }
+    // 在reject中同步调用回调
+    template <typename F> const Promise &listen_error(F &&cb) const {
+        return on_settle([cb = std::forward<F>(cb)](const Future &f) mutable {
+            if (f.state == REJECTED)
+                cb(f.error);
+        });
+    }
+    template <typename F> const Promise &on_settle(F &&cb) const {
+        if (_future->is_settled())
+            cb(*_future);
+        else
+            _future->more().listeners.push_back([cb = std::forward<F>(cb)](Future &f, bool) mutable { cb(f); });
         return *this;
     }
 
+    bool is_resolved() const { return _future->state == FULFILLED; }
+    bool is_rejected() const { return _future->state == REJECTED; }
+    bool is_settled() const { return _future->is_settled(); }
+    const Result &result() const { return *_future->value; }
+    const PromiseError &error() const { return _future->error; }
+    // 登记挂起等待完成的节点, 用于自行管理节点的等待(如with_timeout)
+    void add_waiter(Poll p) const { _future->add_waiter(p); }
+    // 完成后取出结果: 只有本句柄持有共享状态时值移动出来, 否则复制; 仅移动的类型总是移动
+    Settled<T> take() const { return _settled(true); }
+
 #if __cplusplus >= 202002L
-    // 协程中支持等待Promise
-    auto operator co_await() {
-        struct Awaiter {
-            Promise<void> _promise;
-            bool await_ready() const {
-                return *_promise._is_resolved;
+    // 协程中等待Promise, 得到Settled<T>: 被reject时不带值, 错误交给等待者.
+    // 等待者只持有Promise指针, 被等待的Promise在整个co_await表达式期间有效.
+    // 等待临时Promise且没有其他持有者时结果直接移动出来
+    template <bool Move> struct Awaiter {
+        const Promise *p;
+        bool await_ready() const { return p->is_settled(); }
+        void await_suspend(std::coroutine_handle<> h) const {
+            Poll node = set_poll([h](Poll node) {
+                node.remove();
+                h.resume();
+            });
+            node.park();
+            p->add_waiter(node);
+        }
+        Settled<T> await_resume() const { return p->_settled(Move); }
+    };
+    Awaiter<false> operator co_await() const & { return {this}; }
+    Awaiter<true> operator co_await() const && { return {this}; }
+#endif // C++20
+
+private:
+    explicit Promise(Rc<Future> f) : _future(std::move(f)) {}
+
+    // 已完成的结果交给等待者, may_move且只有本句柄持有共享状态时移动
+    Settled<T> _settled(bool may_move) const {
+        auto &f = *_future;
+        Settled<T> r;
+        if (f.state == REJECTED) {
+            r.error = f.error;
+            if constexpr (std::is_void_v<T>)
+                r.rejected = true;
+            return r;
+        }
+        if constexpr (!std::is_void_v<T>) {
+            if constexpr (std::is_copy_constructible_v<T>) {
+                if (!may_move || _future.use_count() > 1) {
+                    r.value.emplace(*f.value);
+                    return r;
+                }
             }
-            void await_suspend(std::coroutine_handle<> awaiting) {
-                _promise.then_([awaiting]{
-                    awaiting.resume();
-                });
+            r.value.emplace(std::move(*f.value));
+        }
+        return r;
+    }
+
+    // 把结果交给回调: 只有本延续持有共享状态或类型仅可移动时移动, 否则传常引用, 回调按值接收时复制
+    template <typename F> static decltype(auto) _call(F &cb, Future &f, bool sole) {
+        if constexpr (std::is_void_v<T>) {
+            if constexpr (std::is_invocable_v<F &>)
+                return cb();
+            else
+                return cb(*f.value);
+        } else if constexpr (!std::is_copy_constructible_v<T>) {
+            return cb(std::move(*f.value));
+        } else {
+            if (sole)
+                return cb(std::move(*f.value));
+            if constexpr (std::is_invocable_v<F &, const T &>)
+                return cb(std::as_const(*f.value));
+            else
+                return cb(T(*f.value));
+        }
+    }
+    template <typename F> using _Ret = decltype(_call(std::declval<F &>(), std::declval<Future &>(), true));
+
+    // 把src的结果原样转给dst
+    static void _forward(Future &src, bool sole, Future &dst) {
+        if (src.state == REJECTED) {
+            dst.reject(src.error);
+        } else if constexpr (std::is_copy_constructible_v<Result>) {
+            if (sole)
+                dst.fulfill(std::move(*src.value));
+            else
+                dst.fulfill(*src.value);
+        } else {
+            dst.fulfill(std::move(*src.value));
+        }
+    }
+
+    // 执行产生结果的回调, 结果交给next; 回调返回Promise时等它完成后再转交
+    template <typename Next, typename Thunk>
+    static void _settle_next(const Rc<typename Next::Future> &next, Thunk &&thunk) {
+        using R = decltype(thunk());
+        if constexpr (std::is_void_v<R>) {
+            thunk();
+            next->fulfill();
+        } else if constexpr (_IsPromise<R>::value) {
+            R inner = thunk();
+            inner._continue([next](typename R::Future &src, bool sole) { R::_forward(src, sole, *next); });
+        } else {
+            next->fulfill(thunk());
+        }
+    }
+
+    // 登记延续节点: 完成后在下一轮调用g(future, sole), sole表示只有本节点还持有共享状态
+    template <typename G> void _continue(G &&g) const {
+        bool pending = !_future->is_settled();
+        Poll p = set_poll([future = _future, g = std::forward<G>(g)](Poll poll) mutable {
+            if (!future->is_settled()) {
+                future->add_waiter(poll);
+                poll.park();
+                return;
             }
-            void await_resume() {}
-        };
-        return Awaiter{*this};
+            poll.remove();
+            bool sole = future.use_count() == 1;
+            g(*future, sole);
+        });
+        if (pending) {
+            // 挂起等待完成唤醒
+            p.park();
+            _future->add_waiter(p);
+        }
     }
-#endif // C++20
 
-private:
-    Shared<bool> _is_resolved;
+    Rc<Future> _future;
 };
 
 template <typename... Promises> auto promise_all(const Promises &...promises) {
@@ -147,8 +420,8 @@ template <typename ResultTuple, typename... Promises, size_t... Is>
 void handle_promises_impl(std::shared_ptr<ResultTuple> results,
                           std::shared_ptr<size_t> resolved_count, size_t count, auto resolve,
                           std::index_sequence<Is...>, const Promises &...promises) {
-    // 使用折叠表达式和索引为每个promise创建特定的处理函数
-    (promises.then([=](const typename Promises::Result &result) {
+    // 使用折叠表达式和索引为每个promise创建特定的处理函数, 在子promise的resolve中同步计数
+    (promises.listen([=](const typename Promises::Result &result) {
         results->template get<Is>() = result;  // 正确地设置结果到对应的元组位置
         (*resolved_count)++;
         if (*resolved_count == count) {
@@ -156,6 +429,11 @@ void handle_promises_impl(std::shared_ptr<ResultTuple> results,
         }
     }),
      ...);
+    // 任一个被reject时整体reject
+    (promises.listen_error([=](const PromiseError &e) { resolve.reject(e); }), ...);
+    (resolve.depend_on(promises), ...);
 }
 
+extern void _test_promise();
+
 #endif // PROMISE_H
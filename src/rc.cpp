@@ -0,0 +1,51 @@
+#include <rc.h>
+#include <stdio.h>
+#include <assert.h>
+
+RcStats _rc_stats = {};
+
+struct RcProbe {
+    static int alive;
+    int v;
+    RcWeak<RcProbe> self; // 指向自己的弱引用, 析构时释放
+    explicit RcProbe(int v) : v(v) { alive++; }
+    ~RcProbe() { alive--; }
+};
+int RcProbe::alive = 0;
+
+void _test_rc() {
+    printf("Test Rc\n");
+    u32 live = get_rc_stats().live;
+
+    // 强引用归零时析构, 弱引用还在时块保留, lock失败
+    RcWeak<RcProbe> weak;
+    {
+        auto a = make_rc<RcProbe>(7);
+        auto b = a;
+        assert(a.use_count() == 2 && b->v == 7);
+        weak = a;
+        assert(weak.lock()->v == 7);
+        assert(a.use_count() == 2);
+    }
+    assert(RcProbe::alive == 0 && weak.expired() && !weak.lock());
+    assert(get_rc_stats().live == live + 1);
+    weak.reset();
+    assert(get_rc_stats().live == live);
+
+    // 对象持有指向自己的弱引用
+    {
+        auto a = make_rc<RcProbe>(1);
+        a->self = a;
+    }
+    assert(RcProbe::alive == 0 && get_rc_stats().live == live);
+
+    // 释放的块被同类型复用, 池不增长
+    u32 bytes = get_rc_stats().pool_bytes;
+    for (int i = 0; i < 1000; ++i) {
+        auto a = make_rc<RcProbe>(i);
+        RcAny any(a);
+    }
+    assert(get_rc_stats().pool_bytes == bytes && get_rc_stats().live == live);
+    assert(sizeof(Rc<RcProbe>) == sizeof(void *) && sizeof(RcWeak<RcProbe>) == sizeof(void *));
+    printf("Test Rc PASS\n");
+}
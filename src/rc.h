@@ -0,0 +1,183 @@
+#ifndef RC_H
+#define RC_H
+
+#include <types.h>
+#include <new>
+#include <utility>
+
+// 侵入式引用计数的共享状态, 用于Promise, Stream等只在轮询循环中使用的对象:
+// - 计数不是原子的, 强/弱计数与对象放在同一个块中, 强/弱句柄都只有一个指针宽
+// - 块来自按类型划分的内存池, 从一次申请的整块中切分, 释放后留在池中复用, 创建不走全局堆
+// 强引用归零时析构对象, 强弱引用都归零时块回到池中. 只能在轮询循环中使用.
+#ifndef RC_POOL_CHUNK_BLOCKS
+#define RC_POOL_CHUNK_BLOCKS 16 // 每次向堆申请的块数
+#endif
+
+struct RcStats {
+    u32 live;       // 当前占用的块数(包括只剩弱引用的块)
+    u32 peak;       // 占用块数的最高水位
+    u32 pool_bytes; // 各类型的池向堆申请的总字节数
+};
+extern RcStats _rc_stats;
+inline const RcStats &get_rc_stats() { return _rc_stats; }
+
+template <typename T> class RcPool {
+public:
+    struct Block {
+        u32 strong;
+        u32 weak;
+        union {
+            Block *next; // 空闲时链入空闲链表
+            alignas(T) unsigned char mem[sizeof(T)];
+        };
+        T *obj() { return std::launder(reinterpret_cast<T *>(mem)); }
+    };
+
+    static Block *alloc() {
+        if (!_free) {
+            // 整块不归还, 留给同类型的对象复用
+            auto chunk = static_cast<Block *>(::operator new(sizeof(Block) * RC_POOL_CHUNK_BLOCKS));
+            for (u32 i = 0; i < RC_POOL_CHUNK_BLOCKS; ++i) {
+                chunk[i].next = _free;
+                _free = &chunk[i];
+            }
+            _rc_stats.pool_bytes += sizeof(Block) * RC_POOL_CHUNK_BLOCKS;
+        }
+        Block *b = _free;
+        _free = b->next;
+        if (++_rc_stats.live > _rc_stats.peak)
+            _rc_stats.peak = _rc_stats.live;
+        return b;
+    }
+    static void free(Block *b) {
+        b->next = _free;
+        _free = b;
+        _rc_stats.live--;
+    }
+
+private:
+    static inline Block *_free = nullptr;
+};
+
+template <typename T> class RcWeak;
+
+// 强引用
+template <typename T> class Rc {
+    using Block = typename RcPool<T>::Block;
+    template <typename> friend class Rc;
+    template <typename> friend class RcWeak;
+    friend class RcAny;
+    Block *_b = nullptr;
+
+    explicit Rc(Block *b) : _b(b) {} // 已计入强引用
+
+    static void release(Block *b) {
+        if (--b->strong > 0)
+            return;
+        // 析构期间对象可能释放指向自己的弱引用, 先占住块
+        b->weak++;
+        b->obj()->~T();
+        if (--b->weak == 0)
+            RcPool<T>::free(b);
+    }
+
+public:
+    Rc() = default;
+    Rc(std::nullptr_t) {}
+    Rc(const Rc &other) : _b(other._b) {
+        if (_b)
+            _b->strong++;
+    }
+    Rc(Rc &&other) noexcept : _b(std::exchange(other._b, nullptr)) {}
+    Rc &operator=(Rc other) noexcept {
+        std::swap(_b, other._b);
+        return *this;
+    }
+    ~Rc() { reset(); }
+
+    template <typename... A> static Rc make(A &&...args) {
+        Block *b = RcPool<T>::alloc();
+        new (b->mem) T(std::forward<A>(args)...);
+        b->strong = 1;
+        b->weak = 0;
+        return Rc(b);
+    }
+
+    void reset() {
+        if (auto b = std::exchange(_b, nullptr))
+            release(b);
+    }
+    T *get() const { return _b ? _b->obj() : nullptr; }
+    T *operator->() const { return _b->obj(); }
+    T &operator*() const { return *_b->obj(); }
+    explicit operator bool() const { return _b != nullptr; }
+    u32 use_count() const { return _b ? _b->strong : 0; }
+};
+
+// 弱引用: 不阻止对象析构, lock()在对象仍然存活时取得强引用
+template <typename T> class RcWeak {
+    using Block = typename RcPool<T>::Block;
+    Block *_b = nullptr;
+
+public:
+    RcWeak() = default;
+    RcWeak(const Rc<T> &rc) : _b(rc._b) {
+        if (_b)
+            _b->weak++;
+    }
+    RcWeak(const RcWeak &other) : _b(other._b) {
+        if (_b)
+            _b->weak++;
+    }
+    RcWeak(RcWeak &&other) noexcept : _b(std::exchange(other._b, nullptr)) {}
+    RcWeak &operator=(RcWeak other) noexcept {
+        std::swap(_b, other._b);
+        return *this;
+    }
+    ~RcWeak() { reset(); }
+
+    void reset() {
+        auto b = std::exchange(_b, nullptr);
+        if (b && --b->weak == 0 && b->strong == 0)
+            RcPool<T>::free(b);
+    }
+    Rc<T> lock() const {
+        if (!_b || _b->strong == 0)
+            return {};
+        _b->strong++;
+        return Rc<T>(_b);
+    }
+    bool expired() const { return !_b || _b->strong == 0; }
+    u32 use_count() const { return _b ? _b->strong : 0; }
+};
+
+template <typename T, typename... A> Rc<T> make_rc(A &&...args) {
+    return Rc<T>::make(std::forward<A>(args)...);
+}
+
+// 类型擦除的强引用, 用于在一个容器中持有不同类型的状态
+class RcAny {
+    void *_b = nullptr;
+    void (*_release)(void *) = nullptr;
+
+public:
+    template <typename T> RcAny(Rc<T> rc) : _b(std::exchange(rc._b, nullptr)) {
+        _release = [](void *b) { Rc<T>::release(static_cast<typename Rc<T>::Block *>(b)); };
+    }
+    RcAny(RcAny &&other) noexcept : _b(std::exchange(other._b, nullptr)), _release(other._release) {}
+    RcAny &operator=(RcAny &&other) noexcept {
+        std::swap(_b, other._b);
+        std::swap(_release, other._release);
+        return *this;
+    }
+    RcAny(const RcAny &) = delete;
+    RcAny &operator=(const RcAny &) = delete;
+    ~RcAny() {
+        if (_b)
+            _release(_b);
+    }
+};
+
+extern void _test_rc();
+
+#endif // RC_H
@@ -24,7 +24,7 @@ void test_stream()
         // 接收所有数据
         int n = consumer.buf.size();        // 获取当前元素个数
         int *data = new int[n];             // 创建接收数组
-        int m = consumer.buf.copy_to(data, n); // 拷贝, 由于拷贝数量可能少于n(当有多个接收端时), 获取返回的拷贝数量m(真正拷贝的数量)
+        int m = consumer.buf.copy_to(data, n); // 拷贝, 由于拷贝数量可能少于n(当有多个接收端时), 获取返回的拷贝数量m(真正拷贝的数量). 多个接收端都要收到全部数据时用Broadcast
         consumer.buf.pop(m);                // 弹出拷贝的元素个数
         for(int i = 0; i < m; i++) {        // 打印数据
             printf("%d\n", data[i]);
@@ -37,3 +37,128 @@ void test_stream()
         }
     });
 }
+
+#if __cplusplus >= 202002L
+
+#include <async.h>
+#include <frame_pool.h>
+#include <assert.h>
+
+static Stream<int> make_stream(int size, StreamPolicy policy, Stream<int>::Producer *out) {
+    return Stream<int>(size, [out](Stream<int>::Producer producer) { *out = producer; }, policy);
+}
+
+static Async<void> produce_blocking(Stream<int>::Producer producer, int count, int *sent) {
+    for (int i = 1; i <= count; ++i) {
+        bool ok = co_await producer.send_async(i);
+        assert(ok);
+        *sent = i;
+    }
+    producer.finish();
+}
+
+static Async<void> wait_space(Stream<int>::Producer producer, int *result) {
+    *result = (co_await producer.space()) ? 1 : 0;
+}
+
+static Async<void> send_one(Stream<int>::Producer producer, int v, int *result) {
+    *result = (co_await producer.send_async(v)) ? 1 : 0;
+}
+
+void _test_stream() {
+    printf("Test Stream\n");
+    use_virtual_clock();
+    Stream<int>::Producer producer{Rc<Stream<int>::Consumer>()};
+
+    // 丢弃新数据: 容量3, 多出的两个被丢弃并计数
+    {
+        auto s = make_stream(4, StreamPolicy::DROP_NEWEST, &producer);
+        int accepted = 0;
+        for (int i = 1; i <= 5; ++i)
+            accepted += producer.send(i);
+        StreamStats st = s.stats();
+        assert(accepted == 3 && st.sent == 3 && st.dropped == 2 && st.high_water == 3 && st.lag == 3);
+        assert(s.consumer()->buf.front() == 1);
+        s.consumer()->pop();
+        assert(s.stats().lag == 2);
+    }
+    assert(!producer.send(1) && producer.is_closed());
+
+    // 覆盖旧数据: 保留最新的3个
+    {
+        auto s = make_stream(4, StreamPolicy::OVERWRITE_OLDEST, &producer);
+        for (int i = 1; i <= 5; ++i)
+            assert(producer.send(i));
+        StreamStats st = s.stats();
+        assert(st.sent == 5 && st.overwritten == 2 && st.dropped == 0 && st.lag == 3);
+        assert(s.consumer()->buf.front() == 3);
+    }
+
+    // 阻塞: 消费者每10ms取一个, 生产者在满时等待, 不丢数据
+    {
+        auto s = make_stream(4, StreamPolicy::BLOCK, &producer);
+        int sent = 0, sum = 0, last = 0;
+        bool ordered = true;
+        start_task_async([&](Task *) { return produce_blocking(producer, 20, &sent); });
+        Timeout t = set_interval(10, [&, c = s.consumer()] {
+            if (c->buf.is_empty())
+                return;
+            int v = c->buf.front();
+            ordered = ordered && v == last + 1;
+            last = v;
+            sum += v;
+            c->pop();
+        });
+        run_for(5);
+        assert(sent == 3);
+        run_for(1000);
+        t.stop();
+        StreamStats st = s.stats();
+        assert(sent == 20 && sum == 210 && ordered);
+        assert(st.dropped == 0 && st.sent == 20 && st.high_water == 3 && st.lag == 0);
+        s.print_stats("block");
+    }
+
+    // 回调等待空间; 消费者释放后等待的生产者被唤醒, 返回流已关闭
+    int result = -1;
+    {
+        auto s = make_stream(2, StreamPolicy::BLOCK, &producer);
+        producer.send(1);
+        // 满时拒绝的发送计入blocked, 不算丢弃
+        assert(!producer.send(9));
+        assert(s.stats().blocked == 1 && s.stats().dropped == 0 && s.stats().sent == 1);
+        int called = 0;
+        producer.on_space([&called] { called++; });
+        run_once();
+        assert(called == 0);
+        s.consumer()->pop();
+        run_once();
+        assert(called == 1);
+        producer.send(2);
+        start_task_async([&](Task *) { return wait_space(producer, &result); });
+        run_once();
+        assert(result == -1);
+    }
+    run_once();
+    assert(result == 0);
+
+    // 结束后send和send_async都返回false, 不进入缓冲区也不计数
+    {
+        auto s = make_stream(4, StreamPolicy::DROP_NEWEST, &producer);
+        assert(producer.send(1));
+        producer.finish();
+        assert(!producer.send(2));
+        start_task_async([&](Task *) { return send_one(producer, 3, &result); });
+        run_once();
+        assert(result == 0);
+        StreamStats st = s.stats();
+        assert(st.sent == 1 && st.dropped == 0 && st.lag == 1);
+        assert(s.consumer()->buf.front() == 1);
+    }
+    run_once();
+    assert(get_frame_stats().live == 0);
+    use_system_clock();
+    printf("Test Stream PASS\n");
+}
+
+#endif // __cplusplus >= 202002L
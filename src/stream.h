@@ -3,6 +3,29 @@
 
 #include <poll.h>
 #include <buf.h>
+#include <rc.h>
+#include <stdio.h>
+
+#if __cplusplus >= 202002L
+#include <coroutine>
+#endif
+
+// 缓冲区满时的处理策略
+enum class StreamPolicy {
+    DROP_NEWEST,      // 丢弃新数据, send返回false(默认)
+    OVERWRITE_OLDEST, // 覆盖最旧的数据, 适合只关心最新采样的场合
+    BLOCK,            // send返回false, 生产者等到有空间再发送: co_await producer.send_async(v) 或 on_space(cb)
+};
+
+// 每个流的统计, 用于确定缓冲区大小
+struct StreamStats {
+    u32 sent;        // 进入缓冲区的数据数
+    u32 dropped;     // 缓冲区满时丢弃的新数据数
+    u32 blocked;     // BLOCK策略下缓冲区满时拒绝的发送数, 数据留在生产者手中, 不算丢弃
+    u32 overwritten; // 被覆盖的旧数据数
+    u32 high_water;  // 缓冲区中数据数的最高水位
+    u32 lag;         // 当前还未被取走的数据数
+};
 
 template <typename T> class Stream {
 
@@ -10,47 +33,166 @@ public:
     struct Consumer {
         Buf<T> buf;
         bool finished;
-        Consumer(int size): buf(size), finished(false){}
-    };
-    struct Producer {
-        Func<void(T)> send;
-        Func<void()> finish;
-    };
+        Waker waker;
+        StreamPolicy policy;
+        StreamStats counters = {};
+        Waker space; // 等待空间的生产者
+        Consumer(int size, StreamPolicy policy) : buf(size), finished(false), policy(policy) {}
+        // 消费者释放后等待空间的生产者不再等待
+        ~Consumer() { space.wake(); }
 
-    Stream(int size, const Func<void(Producer)> &init) {
-        _priv = std::make_shared<Consumer>(size);
-        auto weak_p = std::weak_ptr<Consumer>(_priv);
-        Producer producer;
-        producer.send = [weak_p](T value) {
-            if(auto p = weak_p.lock()) {
-                p->buf.push(value);
+        // 按策略放入数据, 数据被丢弃或流已结束时返回false
+        bool push(T &&value) {
+            if (finished)
+                return false;
+            if (buf.is_full()) {
+                if (policy == StreamPolicy::BLOCK) {
+                    counters.blocked++;
+                    return false;
+                }
+                if (policy == StreamPolicy::DROP_NEWEST) {
+                    counters.dropped++;
+                    return false;
+                }
+                buf.pop();
+                counters.overwritten++;
             }
-        };
-        producer.finish = [weak_p]() {
-            if(auto p = weak_p.lock()) {
+            buf.push(std::move(value));
+            counters.sent++;
+            u32 n = buf.size();
+            if (n > counters.high_water)
+                counters.high_water = n;
+            waker.wake();
+            return true;
+        }
+        // 取走队首数据并唤醒等待空间的生产者. 直接操作buf的消费者由recv在回调后唤醒
+        void pop() {
+            buf.pop();
+            space.wake();
+        }
+        StreamStats stats() const {
+            StreamStats st = counters;
+            st.lag = buf.size();
+            return st;
+        }
+    };
+
+    // 生产者: 只持有弱引用, 一个指针宽, 消费者都释放后发送无效
+    class Producer {
+        RcWeak<Consumer> _c;
+
+    public:
+        explicit Producer(const Rc<Consumer> &c) : _c(c) {}
+        // 按流的策略发送, 数据被丢弃或流已释放时返回false
+        bool send(T value) const {
+            if (auto p = _c.lock())
+                return p->push(std::move(value));
+            return false;
+        }
+        void finish() const {
+            if (auto p = _c.lock()) {
                 p->finished = true;
+                p->waker.wake();
+                p->space.wake();
+            }
+        }
+        // 流已释放或结束
+        bool is_closed() const {
+            auto p = _c.lock();
+            return !p || p->finished;
+        }
+        // 可以不等待地发送: 有空间, 或者流已关闭(发送立即失败)
+        bool is_writable() const {
+            auto p = _c.lock();
+            return !p || p->finished || !p->buf.is_full();
+        }
+        // 有空间(或流已关闭)时调用cb, 已经可写时立即调用
+        void on_space(PollFunc cb) const {
+            auto p = _c.lock();
+            if (!p || p->finished || !p->buf.is_full()) {
+                cb();
+                return;
             }
-        };
-        init(producer);
+            Poll node = set_poll([c = _c, cb = std::move(cb)](Poll poll) {
+                auto p = c.lock();
+                if (p && !p->finished && p->buf.is_full()) {
+                    p->space.add(poll);
+                    poll.park();
+                    return;
+                }
+                poll.remove();
+                cb();
+            });
+            node.park();
+            p->space.add(node);
+        }
+
+#if __cplusplus >= 202002L
+        // co_await producer.space(): 等到有空间, 流已关闭返回false
+        auto space() const {
+            struct Awaiter {
+                const Producer *p;
+                bool await_ready() const { return p->is_writable(); }
+                void await_suspend(std::coroutine_handle<> h) const { p->on_space([h] { h.resume(); }); }
+                bool await_resume() const { return !p->is_closed(); }
+            };
+            return Awaiter{this};
+        }
+        // co_await producer.send_async(v): 等到有空间再发送, 不丢数据; 流已关闭返回false
+        auto send_async(T value) const {
+            struct Awaiter {
+                const Producer *p;
+                T value;
+                bool await_ready() const { return p->is_writable(); }
+                void await_suspend(std::coroutine_handle<> h) const { p->on_space([h] { h.resume(); }); }
+                bool await_resume() const { return p->send(value); }
+            };
+            return Awaiter{this, value};
+        }
+#endif
+    };
+
+    // 消费者状态连同引用计数从本类型的池中一次分配(见rc.h)
+    template <typename Init, typename = std::enable_if_t<std::is_invocable_v<Init &, Producer>>>
+    Stream(int size, Init &&init, StreamPolicy policy = StreamPolicy::DROP_NEWEST)
+        : _priv(make_rc<Consumer>(size, policy)) {
+        init(Producer(_priv));
     }
     Stream(const Stream &other) {
         _priv = other._priv;
     }
 
     Stream<T> recv(const Func<void(Consumer&)> &recv) const {
-        Shared<Consumer> p = _priv;
+        Rc<Consumer> p = _priv;
         set_poll([p, recv](Poll poll) {
-            if(!p->buf.is_empty())
+            if(!p->buf.is_empty()) {
                 recv(*p);
-            if (p->finished)
+                if (!p->buf.is_full())
+                    p->space.wake();
+            }
+            if (p->finished) {
                 poll.remove();
+            } else if (p->buf.is_empty()) {
+                // 没有数据, 挂起等待send/finish唤醒
+                p->waker.add(poll);
+                poll.park();
+            }
         });
         return *this;
     }
+    const Rc<Consumer> &consumer() const { return _priv; }
+    StreamStats stats() const { return _priv->stats(); }
+    void print_stats(const char *name) const {
+        StreamStats st = stats();
+        printf("%s: sent %u, dropped %u, blocked %u, overwritten %u, high water %u/%d, lag %u\n", name,
+               (unsigned)st.sent, (unsigned)st.dropped, (unsigned)st.blocked, (unsigned)st.overwritten,
+               (unsigned)st.high_water, _priv->buf.buf_size(), (unsigned)st.lag);
+    }
 private:
-    Shared<Consumer> _priv;
+    Rc<Consumer> _priv;
 };
 
 extern void test_stream();
+extern void _test_stream();
 
 #endif // STREAM_H
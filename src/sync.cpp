@@ -0,0 +1,442 @@
+#include <sync.h>
+#include <console.h>
+#include <timeout.h>
+#include <stdio.h>
+#include <assert.h>
+
+static SyncStats _sync_stats[SYNC_KINDS] = {};
+
+const SyncStats &get_sync_stats(SyncKind kind) {
+    return _sync_stats[kind];
+}
+
+// 等待节点的回调: 执行时确认交接; 没有执行就被删除(所属任务结束)时, 析构中检查交给它的所有权
+struct _SyncWaiter {
+    WaitQueue *owner; // 可能交给本节点所有权的队列, 没有时为nullptr
+    PollFunc cb;
+    bool ran = false;
+
+    _SyncWaiter(WaitQueue *owner, PollFunc cb) : owner(owner), cb(std::move(cb)) {}
+    _SyncWaiter(_SyncWaiter &&o) noexcept : owner(std::exchange(o.owner, nullptr)), cb(std::move(o.cb)), ran(o.ran) {}
+    ~_SyncWaiter() {
+        if (owner && !ran)
+            owner->check_lost();
+    }
+    void operator()(Poll p) {
+        ran = true;
+        p.remove();
+        if (owner)
+            owner->confirm(p);
+        cb();
+    }
+};
+
+Poll WaitQueue::waiter(PollFunc cb) {
+    Poll p = set_poll(PollFunc_1(_SyncWaiter(_on_lost ? this : nullptr, std::move(cb))));
+    p.park();
+    return p;
+}
+
+Poll WaitQueue::wait(PollFunc cb) {
+    Poll p = waiter(std::move(cb));
+    push(p);
+    return p;
+}
+
+void WaitQueue::hand(Poll p) {
+    _handed.push_back(p);
+    p.wake();
+}
+
+bool WaitQueue::hand_one() {
+    Poll p = pop();
+    if (p.is_null())
+        return false;
+    hand(p);
+    return true;
+}
+
+void WaitQueue::confirm(Poll p) {
+    for (u32 i = 0; i < _handed.size(); ++i) {
+        if (_handed[i].id == p.id) {
+            _handed[i] = _handed.back();
+            _handed.pop_back();
+            return;
+        }
+    }
+}
+
+// 节点析构时槽位已经回收, 交给它的句柄不再有效; 每个丢失的所有权归还一次
+void WaitQueue::check_lost() {
+    for (u32 i = 0; i < _handed.size();) {
+        if (_handed[i].is_active()) {
+            ++i;
+            continue;
+        }
+        _handed[i] = _handed.back();
+        _handed.pop_back();
+        _on_lost();
+    }
+}
+
+// 同时等待多个队列的节点(如select)只会从其中一个队列中被取出, 在其他队列中留下失效的句柄,
+// 队列增长到一定长度时整体清理, 均摊O(1)
+void WaitQueue::prune() {
+    u32 n = 0;
+    for (u32 i = _head; i < _polls.size(); ++i) {
+        if (_polls[i].is_active())
+            _polls[n++] = _polls[i];
+    }
+    u32 removed = _polls.size() - _head - n;
+    _stats.waiting -= removed;
+    _sync_stats[_kind].waiting -= removed;
+    _polls.resize(n);
+    _head = 0;
+    _prune_at = n * 2 > 8 ? n * 2 : 8;
+}
+
+void WaitQueue::push(Poll p) {
+    if (_polls.size() - _head >= _prune_at)
+        prune();
+    _polls.push_back(p);
+    for (auto st : {&_stats, &_sync_stats[_kind]}) {
+        st->acquires++;
+        st->contended++;
+        if (++st->waiting > st->max_waiting)
+            st->max_waiting = st->waiting;
+    }
+}
+
+void WaitQueue::requeue(Poll p) {
+    if (_head > 0)
+        _polls[--_head] = p;
+    else
+        _polls.insert(_polls.begin(), p);
+    for (auto st : {&_stats, &_sync_stats[_kind]}) {
+        if (++st->waiting > st->max_waiting)
+            st->max_waiting = st->waiting;
+    }
+}
+
+Poll WaitQueue::pop() {
+    while (!is_empty()) {
+        Poll p = _polls[_head++];
+        _stats.waiting--;
+        _sync_stats[_kind].waiting--;
+        if (is_empty()) {
+            _polls.clear();
+            _head = 0;
+        }
+        // 所属任务已结束的等待者跳过
+        if (p.is_active())
+            return p;
+    }
+    return Poll();
+}
+
+bool WaitQueue::wake_one() {
+    Poll p = pop();
+    if (p.is_null())
+        return false;
+    p.wake();
+    return true;
+}
+
+void WaitQueue::wake_all() {
+    while (wake_one()) {
+    }
+}
+
+void WaitQueue::count_acquire() {
+    _stats.acquires++;
+    _sync_stats[_kind].acquires++;
+}
+
+AsyncLockGuard::~AsyncLockGuard() {
+    unlock();
+}
+
+void AsyncLockGuard::unlock() {
+    if (_mutex) {
+        _mutex->unlock();
+        _mutex = nullptr;
+    }
+}
+
+AsyncMutex::AsyncMutex() {
+    _queue.on_lost([this] { unlock(); });
+}
+
+bool AsyncMutex::try_lock() {
+    if (_locked)
+        return false;
+    _locked = true;
+    _queue.count_acquire();
+    return true;
+}
+
+void AsyncMutex::lock(PollFunc cb) {
+    if (try_lock())
+        cb();
+    else
+        _queue.wait(std::move(cb));
+}
+
+void AsyncMutex::unlock() {
+    assert(_locked);
+    // 锁保持为持有状态, 直接交给队首的等待者
+    if (!_queue.hand_one())
+        _locked = false;
+}
+
+void AsyncMutex::lock_or_enqueue(Poll p) {
+    if (try_lock())
+        _queue.hand(p);
+    else
+        _queue.push(p);
+}
+
+AsyncSemaphore::AsyncSemaphore(u32 count) : _count(count) {
+    _queue.on_lost([this] { release(); });
+}
+
+bool AsyncSemaphore::try_acquire() {
+    if (_count == 0)
+        return false;
+    _count--;
+    _queue.count_acquire();
+    return true;
+}
+
+void AsyncSemaphore::acquire(PollFunc cb) {
+    if (try_acquire())
+        cb();
+    else
+        _queue.wait(std::move(cb));
+}
+
+void AsyncSemaphore::release(u32 n) {
+    while (n > 0 && _queue.hand_one())
+        n--;
+    _count += n;
+}
+
+void AsyncEvent::set() {
+    _set = true;
+    _queue.wake_all();
+}
+
+void AsyncEvent::wait(PollFunc cb) {
+    if (_set) {
+        _queue.count_acquire();
+        cb();
+    } else {
+        _queue.wait(std::move(cb));
+    }
+}
+
+void AsyncCondVar::enqueue(AsyncMutex &m, Poll p) {
+    assert(m.is_locked() && (_mutex == nullptr || _mutex == &m));
+    _mutex = &m;
+    _queue.push(p);
+    m.unlock();
+}
+
+void AsyncCondVar::wait(AsyncMutex &m, PollFunc cb) {
+    // 被通知后由互斥锁的队列交给它锁
+    enqueue(m, m._queue.waiter(std::move(cb)));
+}
+
+void AsyncCondVar::notify_one() {
+    Poll p = _queue.pop();
+    if (p.is_not_null())
+        _mutex->lock_or_enqueue(p);
+}
+
+void AsyncCondVar::notify_all() {
+    for (Poll p = _queue.pop(); p.is_not_null(); p = _queue.pop())
+        _mutex->lock_or_enqueue(p);
+}
+
+void cmd_sync(Env e) {
+    static const char *const names[SYNC_KINDS] = {"mutex", "semaphore", "event", "condvar", "channel"};
+    auto &io = e.io();
+    io.printf("%-10s %10s %10s %8s %8s\n", "kind", "acquires", "contended", "waiting", "max");
+    for (int k = 0; k < SYNC_KINDS; ++k) {
+        auto &st = _sync_stats[k];
+        io.printf("%-10s %10u %10u %8u %8u\n", names[k], (unsigned)st.acquires, (unsigned)st.contended,
+                  (unsigned)st.waiting, (unsigned)st.max_waiting);
+    }
+    io.flush();
+    e.exit(0);
+}
+
+#if __cplusplus >= 202002L
+
+#include <async.h>
+
+static Async<void> locker(AsyncMutex *m, Vec<int> *order, int id, u32 hold_ms) {
+    co_await m->lock();
+    order->push_back(id);
+    co_await sleep_ms(hold_ms);
+    m->unlock();
+}
+
+static Async<void> limited(AsyncSemaphore *s, int *inside, int *max_inside) {
+    co_await s->acquire();
+    if (++*inside > *max_inside)
+        *max_inside = *inside;
+    co_await sleep_ms(10);
+    --*inside;
+    s->release();
+}
+
+static Async<void> event_waiter(AsyncEvent *e, int *woken) {
+    co_await e->wait();
+    ++*woken;
+}
+
+struct Mailbox {
+    AsyncMutex mutex;
+    AsyncCondVar cv;
+    Vec<int> items;
+    bool closed = false;
+};
+
+static Async<void> channel_consumer(Mailbox *ch, int *sum) {
+    auto guard = co_await ch->mutex.scoped_lock();
+    while (true) {
+        while (ch->items.empty() && !ch->closed)
+            co_await ch->cv.wait(ch->mutex);
+        if (ch->items.empty())
+            break;
+        *sum += ch->items.back();
+        ch->items.pop_back();
+    }
+}
+
+static Async<void> channel_producer(Mailbox *ch, int count) {
+    for (int i = 1; i <= count; ++i) {
+        co_await sleep_ms(5);
+        auto guard = co_await ch->mutex.scoped_lock();
+        ch->items.push_back(i);
+        ch->cv.notify_one();
+    }
+    auto guard = co_await ch->mutex.scoped_lock();
+    ch->closed = true;
+    ch->cv.notify_all();
+}
+
+void _test_sync() {
+    printf("Test Sync\n");
+    use_virtual_clock();
+
+    // 互斥锁: 按排队顺序获得, 等待期间不占用轮询
+    AsyncMutex m;
+    Vec<int> order;
+    for (int id = 0; id < 4; ++id)
+        start_task_async([&, id](Task *) { return locker(&m, &order, id, 100); });
+    run_once();
+    assert(order.size() == 1 && m.stats().waiting == 3);
+    RunResult r = run_for(50);
+    assert(r.work == 0); // 持有者睡眠, 排队者挂起
+    run_for(1000);
+    assert(order.size() == 4 && order[0] == 0 && order[1] == 1 && order[2] == 2 && order[3] == 3);
+    assert(!m.is_locked() && m.stats().acquires == 4 && m.stats().contended == 3);
+    assert(m.stats().max_waiting == 3 && m.stats().waiting == 0);
+
+    // 排队者所属任务结束后被跳过
+    order.clear();
+    start_task_async([&](Task *) { return locker(&m, &order, 0, 100); });
+    auto victim = start_task_async([&](Task *) { return locker(&m, &order, 1, 100); });
+    start_task_async([&](Task *) { return locker(&m, &order, 2, 100); });
+    run_once();
+    victim->terminal();
+    victim = nullptr; // 任务析构时销毁其协程帧
+    run_for(1000);
+    assert(order.size() == 2 && order[0] == 0 && order[1] == 2 && !m.is_locked());
+
+    // 已被交给锁, 还没执行的等待者所属任务结束: 锁归还, 之后仍能加锁
+    order.clear();
+    assert(m.try_lock());
+    auto handed = start_task_async([&](Task *) { return locker(&m, &order, 1, 100); });
+    run_once();
+    m.unlock();
+    assert(m.is_locked());
+    handed->terminal();
+    handed = nullptr;
+    run_once();
+    assert(!m.is_locked());
+    start_task_async([&](Task *) { return locker(&m, &order, 2, 100); });
+    run_for(1000);
+    assert(order.size() == 1 && order[0] == 2 && !m.is_locked());
+    // 归还时有其他等待者, 锁交给下一个
+    order.clear();
+    assert(m.try_lock());
+    handed = start_task_async([&](Task *) { return locker(&m, &order, 1, 100); });
+    start_task_async([&](Task *) { return locker(&m, &order, 2, 100); });
+    run_once();
+    m.unlock();
+    handed->terminal();
+    handed = nullptr;
+    run_for(1000);
+    assert(order.size() == 1 && order[0] == 2 && !m.is_locked());
+
+    // 信号量: 同时进入的不超过计数
+    AsyncSemaphore sem(2);
+    int inside = 0, max_inside = 0;
+    for (int i = 0; i < 6; ++i)
+        start_task_async([&](Task *) { return limited(&sem, &inside, &max_inside); });
+    run_for(1000);
+    assert(max_inside == 2 && inside == 0 && sem.available() == 2);
+    // 交给等待者的计数随它的任务结束归还
+    AsyncSemaphore empty(0);
+    handed = start_task_async([&](Task *) { return limited(&empty, &inside, &max_inside); });
+    run_once();
+    empty.release();
+    handed->terminal();
+    handed = nullptr;
+    run_once();
+    assert(empty.available() == 1 && inside == 0);
+
+    // 事件: set唤醒全部等待者, 之后的等待立即返回
+    AsyncEvent ev;
+    int woken = 0;
+    for (int i = 0; i < 3; ++i)
+        start_task_async([&](Task *) { return event_waiter(&ev, &woken); });
+    run_for(10);
+    assert(woken == 0);
+    ev.set();
+    run_for(10);
+    assert(woken == 3);
+    start_task_async([&](Task *) { return event_waiter(&ev, &woken); });
+    run_once();
+    assert(woken == 4);
+
+    // 条件变量: 生产者/消费者
+    Mailbox ch;
+    int sum = 0;
+    start_task_async([&](Task *) { return channel_consumer(&ch, &sum); });
+    start_task_async([&](Task *) { return channel_producer(&ch, 10); });
+    run_for(1000);
+    assert(sum == 55 && !ch.mutex.is_locked());
+
+    // 回调形式
+    bool got = false;
+    m.lock([&] {
+        m.lock([&] {
+            got = true;
+            m.unlock();
+        });
+        m.unlock();
+    });
+    run_once();
+    assert(got && !m.is_locked());
+
+    use_system_clock();
+    run_once();
+    assert(get_frame_stats().live == 0);
+    printf("Test Sync PASS\n");
+}
+
+#endif // __cplusplus >= 202002L
@@ -0,0 +1,224 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <poll.h>
+
+#if __cplusplus >= 202002L
+#include <coroutine>
+#endif
+
+// 协程/任务间的同步原语. 等待者是挂起的节点, 按先进先出排队, 不占用轮询;
+// 释放时直接把所有权交给队首的等待者并唤醒它, 后来者不能插队.
+// 只能在轮询循环中使用. 等待者所属任务结束后, 其节点在轮到时被跳过;
+// 已被交给所有权但还没执行的等待者被删除时, 锁(计数)归还给下一个等待者.
+// 原语销毁时不能还有等待者.
+
+// 争用统计
+struct SyncStats {
+    u32 acquires;    // 获取次数(加锁, 获取信号量, 等待事件/条件变量)
+    u32 contended;   // 其中需要排队等待的次数
+    u32 waiting;     // 当前排队的等待者数
+    u32 max_waiting; // 排队等待者数的最高水位
+};
+enum SyncKind { SYNC_MUTEX, SYNC_SEMAPHORE, SYNC_EVENT, SYNC_CONDVAR, SYNC_CHANNEL, SYNC_KINDS };
+// 同类原语的统计汇总
+extern const SyncStats &get_sync_stats(SyncKind kind);
+
+// 先进先出的等待队列
+class WaitQueue {
+    Vec<Poll> _polls;
+    u32 _head = 0;
+    u32 _prune_at = 8; // 队列达到此长度时清理已删除的等待者
+    SyncKind _kind;
+    SyncStats _stats = {};
+    Vec<Poll> _handed; // 已交给所有权, 还没执行的等待者
+    PollFunc _on_lost; // 交出的所有权随等待者删除时调用, 归还所有权
+
+    void prune();
+
+public:
+    explicit WaitQueue(SyncKind kind) : _kind(kind) {}
+    WaitQueue(const WaitQueue &) = delete;
+    WaitQueue &operator=(const WaitQueue &) = delete;
+
+    // 创建挂起的等待节点并排到队尾, 被唤醒时执行cb并删除节点
+    Poll wait(PollFunc cb);
+    // 创建挂起的等待节点, 不排队. 所有权通过hand交给它, 它在执行前被删除时调用on_lost
+    Poll waiter(PollFunc cb);
+    // 设置所有权随等待者丢失时的处理(互斥锁, 信号量)
+    void on_lost(PollFunc cb) { _on_lost = std::move(cb); }
+    // 唤醒等待者p, 并把所有权交给它, 它执行时确认
+    void hand(Poll p);
+    // 取出队首的等待者并交给它所有权, 没有时返回false
+    bool hand_one();
+    // 等待节点执行时确认交接
+    void confirm(Poll p);
+    // 等待节点删除时检查交出的所有权是否随之丢失
+    void check_lost();
+    // 已有的挂起节点排到队尾(条件变量通知后转到互斥锁的队列), 计一次排队的获取
+    void push(Poll p);
+    // 被唤醒后条件仍不成立的等待者排回队首, 不丢失原来的位置, 不再计入获取
+    void requeue(Poll p);
+    // 取出队首仍然有效的等待者, 没有时返回空句柄
+    Poll pop();
+    // 唤醒队首的等待者, 没有时返回false
+    bool wake_one();
+    void wake_all();
+    bool is_empty() const { return _head == _polls.size(); }
+    // 记一次未排队的获取
+    void count_acquire();
+    const SyncStats &stats() const { return _stats; }
+};
+
+#if __cplusplus >= 202002L
+// 等待节点被唤醒时恢复协程
+struct _SyncResume {
+    std::coroutine_handle<> h;
+    void operator()() const { h.resume(); }
+};
+#endif
+
+class AsyncMutex;
+
+// 作用域锁, 析构时解锁
+class AsyncLockGuard {
+    AsyncMutex *_mutex;
+
+public:
+    explicit AsyncLockGuard(AsyncMutex *m) : _mutex(m) {}
+    AsyncLockGuard(AsyncLockGuard &&other) noexcept : _mutex(std::exchange(other._mutex, nullptr)) {}
+    AsyncLockGuard(const AsyncLockGuard &) = delete;
+    AsyncLockGuard &operator=(const AsyncLockGuard &) = delete;
+    ~AsyncLockGuard();
+    void unlock();
+};
+
+class AsyncMutex {
+    friend class AsyncCondVar;
+    WaitQueue _queue{SYNC_MUTEX};
+    bool _locked = false;
+
+    // 把已挂起的节点p交给锁: 空闲时直接持有并唤醒, 否则排队
+    void lock_or_enqueue(Poll p);
+
+public:
+    AsyncMutex();
+    bool try_lock();
+    // 获得锁后调用cb, 锁空闲时立即调用
+    void lock(PollFunc cb);
+    // 解锁, 有等待者时锁直接交给队首的等待者
+    void unlock();
+    bool is_locked() const { return _locked; }
+    const SyncStats &stats() const { return _queue.stats(); }
+
+#if __cplusplus >= 202002L
+    // co_await m.lock(); ... m.unlock();
+    auto lock() {
+        struct Awaiter {
+            AsyncMutex *m;
+            bool await_ready() { return m->try_lock(); }
+            void await_suspend(std::coroutine_handle<> h) { m->_queue.wait(_SyncResume{h}); }
+            void await_resume() {}
+        };
+        return Awaiter{this};
+    }
+    // auto guard = co_await m.scoped_lock(); 离开作用域时解锁
+    auto scoped_lock() {
+        struct Awaiter {
+            AsyncMutex *m;
+            bool await_ready() { return m->try_lock(); }
+            void await_suspend(std::coroutine_handle<> h) { m->_queue.wait(_SyncResume{h}); }
+            AsyncLockGuard await_resume() { return AsyncLockGuard(m); }
+        };
+        return Awaiter{this};
+    }
+#endif
+};
+
+class AsyncSemaphore {
+    WaitQueue _queue{SYNC_SEMAPHORE};
+    u32 _count;
+
+public:
+    explicit AsyncSemaphore(u32 count);
+    bool try_acquire();
+    void acquire(PollFunc cb);
+    // 归还n个计数, 依次交给排队的等待者, 余下的计入可用计数
+    void release(u32 n = 1);
+    u32 available() const { return _count; }
+    const SyncStats &stats() const { return _queue.stats(); }
+
+#if __cplusplus >= 202002L
+    auto acquire() {
+        struct Awaiter {
+            AsyncSemaphore *s;
+            bool await_ready() { return s->try_acquire(); }
+            void await_suspend(std::coroutine_handle<> h) { s->_queue.wait(_SyncResume{h}); }
+            void await_resume() {}
+        };
+        return Awaiter{this};
+    }
+#endif
+};
+
+// 手动复位的事件: set后所有等待者被唤醒, 之后的等待立即返回, 直到reset
+class AsyncEvent {
+    WaitQueue _queue{SYNC_EVENT};
+    bool _set = false;
+
+public:
+    void set();
+    void reset() { _set = false; }
+    bool is_set() const { return _set; }
+    void wait(PollFunc cb);
+    const SyncStats &stats() const { return _queue.stats(); }
+
+#if __cplusplus >= 202002L
+    auto wait() {
+        struct Awaiter {
+            AsyncEvent *e;
+            bool await_ready() {
+                if (!e->_set)
+                    return false;
+                e->_queue.count_acquire();
+                return true;
+            }
+            void await_suspend(std::coroutine_handle<> h) { e->_queue.wait(_SyncResume{h}); }
+            void await_resume() {}
+        };
+        return Awaiter{this};
+    }
+#endif
+};
+
+// 条件变量: 等待前必须持有互斥锁, 等待时释放, 被通知后重新持有锁再继续执行.
+// 没有虚假唤醒, 但被通知时条件仍可能已被先获得锁的一方改变, 应在循环中检查条件.
+class AsyncCondVar {
+    WaitQueue _queue{SYNC_CONDVAR};
+    AsyncMutex *_mutex = nullptr;
+
+    void enqueue(AsyncMutex &m, Poll p);
+
+public:
+    void wait(AsyncMutex &m, PollFunc cb);
+    void notify_one();
+    void notify_all();
+    const SyncStats &stats() const { return _queue.stats(); }
+
+#if __cplusplus >= 202002L
+    auto wait(AsyncMutex &m) {
+        struct Awaiter {
+            AsyncCondVar *cv;
+            AsyncMutex *m;
+            bool await_ready() { return false; }
+            void await_suspend(std::coroutine_handle<> h) { cv->wait(*m, _SyncResume{h}); }
+            void await_resume() {}
+        };
+        return Awaiter{this, &m};
+    }
+#endif
+};
+
+extern void _test_sync();
+
+#endif // SYNC_H
@@ -0,0 +1,184 @@
+#include <task_group.h>
+#include <timeout.h>
+#include <frame_pool.h>
+#include <stdio.h>
+#include <assert.h>
+
+class _GroupTask : public Task {
+    friend class TaskGroup;
+    TaskGroup *_group;
+    List<Shared<_GroupTask>>::iterator _it;
+    Func<void(Task *)> _cb;
+
+public:
+    _GroupTask(TaskGroup *group, const Func<void(Task *)> &cb) : _group(group), _cb(cb) {}
+
+protected:
+    void init() override { _cb(this); }
+    void exited() override {
+        if (_group)
+            _group->child_exited(this);
+    }
+};
+
+TaskGroup::TaskGroup() {
+    auto owner = get_current_task();
+    _owner = owner;
+    if (owner)
+        owner->_groups.push_back(this);
+}
+
+TaskGroup::~TaskGroup() {
+    cancel();
+    for (auto &child : _children)
+        child->_group = nullptr;
+    _children.clear();
+    for (auto &p : _joiners)
+        p.remove();
+    if (auto owner = _owner.lock()) {
+        auto &groups = owner->_groups;
+        for (u32 i = 0; i < groups.size(); ++i) {
+            if (groups[i] == this) {
+                groups[i] = groups.back();
+                groups.pop_back();
+                break;
+            }
+        }
+    }
+}
+
+Shared<Task> TaskGroup::spawn(const Func<void(Task *)> &cb) {
+    auto task = make_shared<_GroupTask>(this, cb);
+    task->_it = _children.insert(_children.end(), task);
+    start_task(task);
+    if (_cancelled)
+        task->terminal();
+    return task;
+}
+
+Shared<Task> TaskGroup::spawn(const Str &name, const Func<void(Task *)> &cb) {
+    auto task = spawn(cb);
+    task->set_name(name);
+    return task;
+}
+
+void TaskGroup::cancel() {
+    _cancelled = true;
+    for (auto &child : _children)
+        child->terminal();
+}
+
+void TaskGroup::join(PollFunc cb) {
+    if (_children.empty()) {
+        cb();
+        return;
+    }
+    Poll p = set_poll([cb = std::move(cb)](Poll p) {
+        p.remove();
+        cb();
+    });
+    p.park();
+    _joiners.push_back(p);
+}
+
+void TaskGroup::child_exited(_GroupTask *child) {
+    child->_group = nullptr;
+    _children.erase(child->_it);
+    if (_children.empty()) {
+        auto joiners = std::move(_joiners);
+        _joiners.clear();
+        for (auto &p : joiners)
+            p.wake();
+    }
+}
+
+#if __cplusplus >= 202002L
+
+static Async<void> sleeper(u32 ms, int *finished) {
+    co_await sleep_ms(ms);
+    ++*finished;
+}
+
+static Async<void> join_children(int *finished, bool *joined) {
+    TaskGroup group;
+    for (u32 i = 1; i <= 3; ++i)
+        group.spawn_async([=](Task *) { return sleeper(i * 10, finished); });
+    co_await group.join();
+    *joined = true;
+}
+
+static Async<void> scoped_children(int *finished, bool *returned) {
+    co_await task_scope([=](TaskGroup &group) -> Async<void> {
+        for (u32 i = 1; i <= 3; ++i)
+            group.spawn_async([=](Task *) { return sleeper(i * 10, finished); });
+        co_return;
+    });
+    *returned = true;
+}
+
+// 每层启动fanout个子任务, 叶子永久睡眠
+static Async<void> tree(int depth, int fanout, int *started) {
+    ++*started;
+    TaskGroup group;
+    if (depth == 0) {
+        co_await sleep_ms(0xffffffff / 2);
+    } else {
+        for (int i = 0; i < fanout; ++i)
+            group.spawn_async([=](Task *) { return tree(depth - 1, fanout, started); });
+    }
+    co_await group.join();
+}
+
+void _test_task_group() {
+    printf("Test TaskGroup\n");
+    use_virtual_clock();
+
+    // join等待全部子任务结束
+    int finished = 0;
+    bool joined = false;
+    start_task_async([&](Task *) { return join_children(&finished, &joined); });
+    run_for(25);
+    assert(finished == 2 && !joined);
+    run_for(10);
+    assert(finished == 3 && joined);
+
+    // task_scope在body返回后等到全部子任务结束才返回
+    finished = 0;
+    bool returned = false;
+    start_task_async([&](Task *) { return scoped_children(&finished, &returned); });
+    run_for(25);
+    assert(finished == 2 && !returned);
+    run_for(10);
+    assert(finished == 3 && returned);
+
+    // 终止根任务, 取消沿任务组传播到整棵树
+    int started = 0;
+    auto root = start_task_async([&](Task *) { return tree(3, 3, &started); });
+    run_for(10);
+    assert(started == 1 + 3 + 9 + 27);
+    root->terminal();
+    run_for(10);
+    assert(get_frame_stats().live == 1); // 只剩根任务的帧, 随root释放
+    root = nullptr;
+    run_once();
+    assert(get_frame_stats().live == 0);
+
+    // 组取消后启动的子任务不会运行, 组析构时取消剩余的子任务
+    int ran = 0;
+    {
+        TaskGroup group;
+        group.cancel();
+        group.spawn([&ran](Task *) { ran++; });
+        TaskGroup other;
+        other.spawn_async([&](Task *) { return sleeper(1000, &finished); });
+        run_once();
+        assert(other.size() == 1);
+    }
+    run_for(2000);
+    assert(ran == 0 && finished == 3);
+    assert(get_frame_stats().live == 0);
+    use_system_clock();
+    printf("Test TaskGroup PASS\n");
+}
+
+#endif // __cplusplus >= 202002L
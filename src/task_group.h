@@ -0,0 +1,74 @@
+#ifndef TASK_GROUP_H
+#define TASK_GROUP_H
+
+#include <poll.h>
+
+#if __cplusplus >= 202002L
+#include <async.h>
+#endif
+
+// 任务组(结构化并发): 拥有在组内启动的子任务.
+// - 组属于创建它时的当前任务, 该任务被terminal时组内子任务一并取消, 子任务中的组继续向下传播
+// - join等待全部子任务结束. 析构函数不能挂起等待, 所以组析构时取消仍在运行的子任务;
+//   需要"离开作用域时等待子任务"时用task_scope, 它在返回前co_await join
+//   (等待期间所在协程被销毁时, 组随帧析构取消子任务)
+// - 子任务退出时O(1)地从组中移除, 取消的代价与子任务数成正比, 不遍历全局节点
+class _GroupTask;
+class TaskGroup {
+    friend class _GroupTask;
+    List<Shared<_GroupTask>> _children;
+    Weak<Task> _owner;  // 创建时的当前任务, 可能为空
+    Vec<Poll> _joiners; // 挂起等待全部子任务结束的节点
+    bool _cancelled = false;
+
+    void child_exited(_GroupTask *child);
+
+public:
+    TaskGroup();
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+    ~TaskGroup();
+
+    // 在组内启动子任务; 组已取消时子任务不会启动
+    Shared<Task> spawn(const Func<void(Task *)> &cb);
+    Shared<Task> spawn(const Str &name, const Func<void(Task *)> &cb);
+    // 取消全部子任务, 之后启动的子任务也立即取消
+    void cancel();
+    bool is_cancelled() const { return _cancelled; }
+    // 运行中的子任务数
+    u32 size() const { return _children.size(); }
+    // 全部子任务结束后调用cb, 已经没有子任务时立即调用
+    void join(PollFunc cb);
+
+#if __cplusplus >= 202002L
+    Shared<Task> spawn_async(const Func<Async<void>(Task *)> &cb) {
+        return spawn([cb](Task *task) { cb(task).detach(); });
+    }
+    // co_await group.join();
+    auto join() {
+        struct Awaiter {
+            TaskGroup *g;
+            bool await_ready() const { return g->_children.empty(); }
+            void await_suspend(std::coroutine_handle<> h) {
+                g->join([h] { h.resume(); });
+            }
+            void await_resume() {}
+        };
+        return Awaiter{this};
+    }
+#endif
+};
+
+#if __cplusplus >= 202002L
+// 结构化作用域: co_await task_scope([](TaskGroup &g) -> Async<void> {...});
+// body中在组内启动子任务, body结束后等待全部子任务结束才返回. body保存在作用域的帧中, 可以按值捕获
+template <typename F> Async<void> task_scope(F body) {
+    TaskGroup group;
+    co_await body(group);
+    co_await group.join();
+}
+#endif
+
+extern void _test_task_group();
+
+#endif // TASK_GROUP_H
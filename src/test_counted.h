@@ -0,0 +1,39 @@
+#ifndef TEST_COUNTED_H
+#define TEST_COUNTED_H
+
+// 测试用负载: 统计复制, 移动次数和存活对象数, 检查数据在各原语间传递时没有多余的复制.
+// 没有默认构造, 同时检查原语不要求T可默认构造. 计数是全局的, 每个测试开始前reset()
+struct Counted {
+    static inline int copies = 0;
+    static inline int moves = 0;
+    static inline int live = 0;
+    int value;
+
+    explicit Counted(int value) : value(value) { live++; }
+    Counted(const Counted &o) : value(o.value) {
+        copies++;
+        live++;
+    }
+    Counted(Counted &&o) noexcept : value(o.value) {
+        moves++;
+        live++;
+    }
+    Counted &operator=(const Counted &o) {
+        value = o.value;
+        copies++;
+        return *this;
+    }
+    Counted &operator=(Counted &&o) noexcept {
+        value = o.value;
+        moves++;
+        return *this;
+    }
+    ~Counted() { live--; }
+
+    static void reset() {
+        copies = 0;
+        moves = 0;
+    }
+};
+
+#endif // TEST_COUNTED_H
@@ -4,66 +4,238 @@
  */
 
 #include <memory>
+#include <stdio.h>
+#include <assert.h>
 #include <poll.h>
 #include <timeout.h>
 
+#ifdef _STM32
+uint64_t get_sys_tick_us() {
+    static uint32_t last = 0;
+    static uint64_t high = 0;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0) {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    uint32_t cycles = DWT->CYCCNT;
+    if (cycles < last)
+        high += 1ull << 32;
+    last = cycles;
+    uint64_t total = high | cycles;
+    __set_PRIMASK(primask);
+    return total / (SystemCoreClock / 1000000);
+}
+#endif
+
+ClockFunc _clock_source = get_sys_tick_us;
+static uint64_t _virtual_us = 0;
+static IdleFunc _saved_idle_hook; // 切换到虚拟时钟前的空闲钩子
+
+static uint64_t get_virtual_tick_us() {
+    return _virtual_us;
+}
+
+// 空闲时跳到下一个定时器到期, 没有定时器时时间不动
+static void virtual_idle_hook(uint32_t ms) {
+    if (ms != POLL_IDLE_FOREVER)
+        _virtual_us += (uint64_t)ms * 1000;
+}
+
+void set_clock_source(ClockFunc clock) {
+    _clock_source = clock ? clock : get_sys_tick_us;
+}
+
+void use_virtual_clock() {
+    if (is_virtual_clock())
+        return;
+    _virtual_us = get_tick_us();
+    set_clock_source(get_virtual_tick_us);
+    _saved_idle_hook = get_idle_hook();
+    set_idle_hook(virtual_idle_hook);
+}
+
+void use_system_clock() {
+    if (!is_virtual_clock())
+        return;
+    set_clock_source(nullptr);
+    set_idle_hook(_saved_idle_hook);
+    _saved_idle_hook = nullptr;
+}
+
+bool is_virtual_clock() {
+    return _clock_source == get_virtual_tick_us;
+}
+
+void advance_virtual_clock(uint32_t ms) {
+    _virtual_us += (uint64_t)ms * 1000;
+}
+
+void advance_virtual_clock_us(uint64_t us) {
+    _virtual_us += us;
+}
+
 void Timeout::stop() const {
     return this->remove();
 }
 
-Timeout set_timeout(uint32_t ms, const TimeoutFunc &cb) {
-    uint32_t escape = get_tick_ms() + ms;
-    Poll poll = set_poll([=](Poll poll) {
-        if (get_tick_ms() >= escape) {
-            cb();
-            poll.remove();
-        }
-    });
-    return {poll.id};
+Timeout set_timeout(uint32_t ms, TimeoutFunc cb) {
+    return set_timer(ms, 0, std::move(cb));
 }
 
-Timeout set_timeout(uint32_t ms, const TimeoutFunc_1 &cb) {
-    uint32_t escape = get_tick_ms() + ms;
-    Poll pid = set_poll([=](Poll pid) {
-        if (get_tick_ms() >= escape) {
-            cb({pid.id});
-            pid.remove();
-        }
-    });
-    return {pid.id};
+Timeout set_timeout(uint32_t ms, TimeoutFunc_1 cb) {
+    return set_timer(ms, 0, std::move(cb));
+}
+
+// 周期为0时按时间轮最小精度1ms重复
+Timeout set_interval(uint32_t ms, TimeoutFunc cb) {
+    return set_timer(ms, ms ? ms : 1, std::move(cb));
+}
+
+Timeout set_interval(uint32_t ms, TimeoutFunc_1 cb) {
+    return set_timer(ms, ms ? ms : 1, std::move(cb));
 }
 
-Timeout set_interval(uint32_t ms, const TimeoutFunc &cb) {
-    auto escape = std::make_shared<uint32_t>(get_tick_ms() + ms);
-    Poll pid = set_poll([=](Poll) {
-        uint32_t now = get_tick_ms();
-        if (now >= *escape) {
+// set_timeout_us的毫秒辅助定时器, 随节点的回调析构: 节点被stop或随任务删除时一并删除
+struct _WakeTimer {
+    Timeout timer;
+    _WakeTimer() = default;
+    _WakeTimer(_WakeTimer &&other) noexcept : timer(std::exchange(other.timer, Timeout())) {}
+    ~_WakeTimer() { timer.stop(); }
+};
+
+Timeout set_timeout_us(uint32_t us, TimeoutFunc cb) {
+    uint64_t deadline = get_tick_us() + us;
+    return set_poll([deadline, cb = std::move(cb), wake = _WakeTimer()](Poll p) mutable {
+        uint64_t now = get_tick_us();
+        if (now >= deadline) {
             cb();
-            *escape = now + ms;
+            p.remove();
+            return;
+        }
+        uint64_t left = deadline - now;
+        if (left >= 2000 || is_virtual_clock()) {
+            // 剩余时间较长时挂起, 由毫秒定时器在到期前1ms左右唤醒; 虚拟时钟只能按毫秒推进
+            uint32_t ms = is_virtual_clock() ? (uint32_t)((left + 999) / 1000) : (uint32_t)(left / 1000 - 1);
+            wake.timer = set_timeout(ms, [p] { p.wake(); });
+            p.park();
         }
     });
-    return {pid.id};
 }
 
-Timeout set_interval(uint32_t ms, const TimeoutFunc_1 &cb) {
-    auto escape = std::make_shared<uint32_t>(get_tick_ms() + ms);
-    Poll pid = set_poll([=](Poll pid) {
-        uint32_t now = get_tick_ms();
-        if (now >= *escape) {
-            cb({pid.id});
-            *escape = now + ms;
-        }
-    });
-    return {pid.id};
+static uint64_t _test_us = 0;
+static uint64_t get_test_tick_us() {
+    return _test_us;
 }
 
 void _test_timeout() {
+    printf("Test Timeout\n");
     // 测试 set_timeout
-    set_timeout(1000, [] {
-        printf("Timeout 1s\n");
+    Shared<int> timeouts = make_shared<int>(0);
+    set_timeout(30, [timeouts] {
+        printf("Timeout 30ms\n");
+        (*timeouts)++;
+    });
+    // 测试 set_interval, 带句柄的回调可以停止自身
+    Shared<int> intervals = make_shared<int>(0);
+    Timeout interval = set_interval(10, [intervals](Timeout timer) {
+        printf("Interval 10ms\n");
+        if (++(*intervals) == 5)
+            timer.stop();
     });
-    // 测试 set_interval
-    set_interval(500, [] {
-        printf("Interval 500ms\n");
+    run_until([timeouts, intervals] { return *timeouts == 1 && *intervals == 5; });
+    assert(interval.is_active() == false);
+    run_for(30);
+    assert(*timeouts == 1 && *intervals == 5);
+
+    // 测试虚拟时钟: 模拟1小时的定时器负载
+    use_virtual_clock();
+    u32 start = get_tick_ms();
+    Shared<int> seconds = make_shared<int>(0);
+    Shared<int> ticks = make_shared<int>(0);
+    Timeout second = set_interval(1000, [seconds] { (*seconds)++; });
+    Timeout tick = set_interval(7, [ticks] { (*ticks)++; });
+    RunResult r = run_for(3600 * 1000);
+    assert(get_tick_ms() - start == 3600 * 1000);
+    assert(*seconds == 3600 && *ticks == 3600 * 1000 / 7);
+    assert(r.work == (u32)(*seconds + *ticks));
+    second.stop();
+    tick.stop();
+    // 手动推进
+    bool fired = false;
+    set_timeout(50, [&fired] { fired = true; });
+    advance_virtual_clock(49);
+    run_once();
+    assert(!fired);
+    advance_virtual_clock(1);
+    run_once();
+    assert(fired);
+
+    // 测试微秒定时: 虚拟时钟下按毫秒推进, 不早于到期时间执行
+    u64 us_start = get_tick_us();
+    u64 us_fired = 0;
+    set_timeout_us(2500, [&us_fired] { us_fired = get_tick_us(); });
+    run_until([&us_fired] { return us_fired != 0; });
+    assert(us_fired - us_start >= 2500 && us_fired - us_start < 4000);
+    use_system_clock();
+
+    // 真实时钟下剩余不足2ms时逐轮检查
+    us_start = get_tick_us();
+    us_fired = 0;
+    set_timeout_us(300, [&us_fired] { us_fired = get_tick_us(); });
+    run_until([&us_fired] { return us_fired != 0; });
+    assert(us_fired - us_start >= 300 && us_fired - us_start < 1000);
+    us_start = get_tick_us();
+    us_fired = 0;
+    set_timeout_us(5300, [&us_fired] { us_fired = get_tick_us(); });
+    run_until([&us_fired] { return us_fired != 0; });
+    printf("set_timeout_us(5300): %llu us\n", (unsigned long long)(us_fired - us_start));
+    assert(us_fired - us_start >= 5300);
+
+    // stop微秒定时时删除辅助定时器
+    u32 nodes = get_poll_stats().nodes;
+    Timeout us_timer = set_timeout_us(50000, [&us_fired] { us_fired = 0; });
+    run_once();
+    assert(get_poll_stats().nodes == nodes + 2);
+    us_timer.stop();
+    run_once();
+    assert(get_poll_stats().nodes == nodes);
+
+    // 虚拟时钟期间接管空闲钩子, 切换回平台时钟时恢复用户的钩子
+    int user_idles = 0;
+    set_idle_hook([&user_idles](u32) { user_idles++; });
+    use_virtual_clock();
+    run_for(10);
+    assert(user_idles == 0);
+    use_system_clock();
+    run_for(1);
+    assert(user_idles > 0);
+    set_idle_hook(nullptr);
+
+    // 空闲时长从本轮执行之后算起: 回调耗时30ms, 50ms的定时器只需再睡20ms, 耗时不计为空闲
+    _test_us = get_tick_us();
+    set_clock_source(get_test_tick_us);
+    u32 first_idle = 0, idle_calls = 0;
+    set_idle_hook([&first_idle, &idle_calls](u32 ms) {
+        if (idle_calls++ == 0)
+            first_idle = ms;
+        if (ms != POLL_IDLE_FOREVER)
+            _test_us += (uint64_t)ms * 1000;
     });
+    bool slow_fired = false;
+    u32 busy = get_poll_stats().busy_ms;
+    set_timeout(50, [&slow_fired] { slow_fired = true; });
+    set_timeout(0, [] { _test_us += 30000; });
+    run_until([&slow_fired] { return slow_fired; });
+    assert(first_idle == 20);
+    assert(get_poll_stats().busy_ms - busy >= 30);
+    set_clock_source(nullptr);
+    set_idle_hook(nullptr);
+
+    // 回绕安全比较
+    assert(tick_reached(5, 0xfffffff0u) && !tick_reached(0xfffffff0u, 5));
+    assert(tick_diff(5, 0xfffffff0u) == 21);
+    printf("Test Timeout PASS\n");
 }
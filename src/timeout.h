@@ -9,32 +9,60 @@
 #include <poll.h>
 #include <types.h>
 
-#ifdef _QT
-#include <QDateTime>
-inline uint32_t get_tick_ms() { return QDateTime::currentMSecsSinceEpoch(); }
-#elif defined(_STM32)
+// 平台时钟: 单调递增的64位微秒计数, 不受系统时间调整影响
+#ifdef _STM32
 #include <hal.h>
-inline uint32_t get_tick_ms() { return HAL_GetTick(); }
+// DWT周期计数器扩展到64位(需要Cortex-M3及以上), 两次读取的间隔必须小于一次回绕
+// (168MHz约25秒), 轮询循环每轮都会读取, 正常运行时可以保证
+extern uint64_t get_sys_tick_us();
 #else
-#include <sys/time.h>
 #include <chrono>
-inline uint32_t get_tick_ms() {
-    uint32_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
-    return ms;
+inline uint64_t get_sys_tick_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 #endif
 
+// 时钟源: 调度器和定时器都通过get_tick_us()/get_tick_ms()读取时间, 默认为平台时钟
+using ClockFunc = uint64_t (*)();
+extern ClockFunc _clock_source;
+inline uint64_t get_tick_us() { return _clock_source(); }
+// 毫秒计数是微秒计数截断到32位, 约49.7天回绕一次, 比较时间必须使用tick_reached/tick_diff
+inline uint32_t get_tick_ms() { return (uint32_t)(get_tick_us() / 1000); }
+// 替换时钟源, nullptr恢复平台时钟
+extern void set_clock_source(ClockFunc clock);
+
+// 回绕安全的毫秒时间比较: now是否已到达deadline
+inline bool tick_reached(uint32_t now, uint32_t deadline) { return (int32_t)(now - deadline) >= 0; }
+// 回绕安全的毫秒时间差: to - from, 已过去为负
+inline int32_t tick_diff(uint32_t to, uint32_t from) { return (int32_t)(to - from); }
+
+// 虚拟时钟: 时间不随真实时间流逝, 循环空闲时直接跳到最近的定时器到期,
+// 用于快速测试和基准测试, 模拟数小时的定时器负载只需要毫秒级的真实时间.
+// 从当前时间开始计时, 已有的定时器保持有效. 切换回平台时钟应在没有定时器时进行.
+// 虚拟时钟期间由它接管空闲钩子, 用户设置的钩子不被调用; 切换回平台时钟时恢复.
+extern void use_virtual_clock();
+extern void use_system_clock();
+extern bool is_virtual_clock();
+// 手动推进虚拟时钟
+extern void advance_virtual_clock(uint32_t ms);
+extern void advance_virtual_clock_us(uint64_t us);
+
 struct Timeout : public Poll {
     using Poll::Poll;
+    Timeout(const Poll &p) : Poll(p) {}
     void stop() const;
 };
-using TimeoutFunc = Func<void()>;
-using TimeoutFunc_1 = Func<void(Timeout timer)>;
-extern Timeout set_timeout(uint32_t ms, const TimeoutFunc &cb);
-extern Timeout set_timeout(uint32_t ms, const TimeoutFunc_1 &cb);
-extern Timeout set_interval(uint32_t ms, const TimeoutFunc &cb);
-extern Timeout set_interval(uint32_t ms, const TimeoutFunc_1 &cb);
+// 回调与定时器节点共用InplaceFunc, 带参数的回调可以写成 [](Timeout timer) {...}
+using TimeoutFunc = PollFunc;
+using TimeoutFunc_1 = PollFunc_1;
+extern Timeout set_timeout(uint32_t ms, TimeoutFunc cb);
+extern Timeout set_timeout(uint32_t ms, TimeoutFunc_1 cb);
+extern Timeout set_interval(uint32_t ms, TimeoutFunc cb);
+extern Timeout set_interval(uint32_t ms, TimeoutFunc_1 cb);
+// 微秒定时: 时间轮精度为1ms, 剩余不足2ms时节点留在就绪队列中逐轮检查, 期间循环不进入空闲.
+// 剩余时间较长时由一个毫秒辅助定时器唤醒, stop后它随节点一起删除
+extern Timeout set_timeout_us(uint32_t us, TimeoutFunc cb);
 extern void _test_timeout();
 
 #endif /* TIMEOUT_H_ */
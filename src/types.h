@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <functional>
+#include <optional>
 
 #ifdef QT_CORE_LIB
 #define _QT
@@ -40,10 +41,12 @@ typedef unsigned uint;
 #include <enum.h>
 
 template <typename T> using Func = std::function<T>;
+#include <func.h>
 
 template <typename T> using Unique = std::unique_ptr<T>;
 template <typename T> using Shared = std::shared_ptr<T>;
 template <typename T> using Weak = std::weak_ptr<T>;
+template <typename T> using Optional = std::optional<T>;
 
 using std::make_unique;
 using std::make_shared;
@@ -78,6 +78,7 @@ int UartBuf::write(const void *buf, int n) {
         }
         _tx.push(p[i]);
     }
+    _flush_poll.wake();
     return n;
 }
 
@@ -94,8 +95,21 @@ void UartBuf::flush() {
 
 void UartBuf::uart_intput(char c) { 
     _rx.push(c); 
+    // 可能在中断中, 投递到轮询循环唤醒等待者, 同一时间只投递一次
+    if (!_rx_posted.exchange(true)) {
+        if (!post(rx_ready, this))
+            _rx_posted = false;
+    }
+}
+
+void UartBuf::rx_ready(void *arg) {
+    auto self = (UartBuf *)arg;
+    self->_rx_posted = false;
+    self->_rx_waker.wake();
 }
 
+void UartBuf::wait_rx(Poll p) { _rx_waker.add(p); }
+
 void UartBuf::set_lf2crlf_enable(bool b) { _lf2crlf = b; }
 
 void UartBuf::printf_write_char(char c) {
@@ -115,6 +129,7 @@ void UartBuf::printf_write_char(char c) {
         flush();
     } else {
         _tx.push(c);
+        _flush_poll.wake();
     }
 }
 
@@ -127,5 +142,9 @@ int UartBuf::scanf_read_char() {
 }
 
 void UartBuf::init() {
-    set_poll([this] { flush(); });
+    // 发送缓冲中有未满一行的数据时由putc/write唤醒
+    _flush_poll = set_poll([this](Poll p) {
+        flush();
+        p.park();
+    });
 }
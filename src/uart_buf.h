@@ -5,6 +5,7 @@
 #include <buf.h>
 #include <printf.h>
 #include <scanf.h>
+#include <atomic>
 
 class UartBuf: public Task, public Printf, public Scanf {
 public:
@@ -15,6 +16,9 @@ private:
     Buf<char> _rx;
     WriteFunc _write_cb;
     bool _lf2crlf = false;
+    Poll _flush_poll;
+    Waker _rx_waker;
+    std::atomic<bool> _rx_posted{false};
 public:
     UartBuf(int buf_size, WriteFunc write_cb);
     Buf<char>& tx() { return _tx; }
@@ -33,6 +37,8 @@ public:
 
     // 用于串口中断ISR, 或者轮训输入
     void uart_intput(char c);
+    // 登记等待接收数据的节点, 收到数据时唤醒
+    void wait_rx(Poll p);
     void set_lf2crlf_enable(bool b);
 
     // Printf, Scanf interface
@@ -42,6 +48,7 @@ protected:
 
 private:
     void init() override;
+    static void rx_ready(void *arg);
 };
 
 extern Shared<UartBuf> uart_controller_start(int buf_size, UartBuf::WriteFunc write_cb);
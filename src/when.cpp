@@ -0,0 +1,182 @@
+#include <when.h>
+#include <timeout.h>
+#include <stdio.h>
+#include <assert.h>
+#include <test_counted.h>
+
+static void test_when_promise() {
+    // 子Promise完成时只计数, 聚合Promise的then是唯一的轮询节点
+    Vec<Promise<int>::ResolveFunc> resolvers;
+    Vec<Promise<int>> promises;
+    for (int i = 0; i < 8; ++i)
+        promises.push_back(Promise<int>([&resolvers](auto resolve) { resolvers.push_back(resolve); }));
+    int calls = 0;
+    int sum = 0;
+    when_all(promises).then([&](const Vec<int> &results) {
+        calls++;
+        for (size_t i = 0; i < results.size(); ++i)
+            sum += results[i] * (int)(i + 1);
+    });
+    for (int i = 7; i >= 0; --i) {
+        resolvers[i](i);
+        assert(run_once().work == (i == 0 ? 1u : 0u));
+    }
+    assert(calls == 1 && sum == 168);
+
+    // when_any/race: 第一个resolve的结果, 之后的resolve不再影响
+    Vec<Promise<void>::ResolveFunc> void_resolvers;
+    Vec<Promise<void>> voids;
+    for (int i = 0; i < 3; ++i)
+        voids.push_back(Promise<void>([&void_resolvers](auto resolve) { void_resolvers.push_back(resolve); }));
+    size_t index = 99;
+    bool raced = false;
+    when_any(voids).then([&index](const AnyResult<void> &any) { index = any.index; });
+    race(voids).then_([&raced] { raced = true; });
+    void_resolvers[2]();
+    void_resolvers[0]();
+    run_once();
+    assert(index == 2 && raced);
+
+    // 调用方丢弃子Promise的句柄, 聚合Promise保持它们存活直到完成
+    int dropped_sum = 0;
+    {
+        Vec<Promise<int>> timed;
+        for (int i = 1; i <= 3; ++i)
+            timed.push_back(Promise<int>([i](auto resolve) { set_timeout(i, [resolve, i] { resolve(i); }); }));
+        when_all(timed).then([&dropped_sum](const Vec<int> &results) {
+            for (int v : results)
+                dropped_sum += v;
+        });
+        auto a = Promise<int>([](auto resolve) { set_timeout(1, [resolve] { resolve(10); }); });
+        promise_all(a, Promise<int>([](auto resolve) { set_timeout(2, [resolve] { resolve(20); }); }))
+            .then([&dropped_sum](const Tuple<int, int> &t) { dropped_sum += t.get<0>() + t.get<1>(); });
+    }
+    run_for(10);
+    assert(dropped_sum == 36);
+
+    // 调用方已释放句柄时结果移动进聚合结果, 仍持有句柄时复制, 句柄上的结果不受影响
+    for (bool keep : {false, true}) {
+        Vec<Promise<Counted>::ResolveFunc> counted_resolvers;
+        Vec<Promise<Counted>> counted;
+        for (int i = 0; i < 4; ++i)
+            counted.push_back(
+                Promise<Counted>([&counted_resolvers](auto resolve) { counted_resolvers.push_back(resolve); }));
+        int total = 0;
+        when_all(counted).then([&total](const Vec<Counted> &results) {
+            for (auto &c : results)
+                total += c.value;
+        });
+        if (!keep)
+            counted = Vec<Promise<Counted>>();
+        Counted::reset();
+        for (int i = 0; i < 4; ++i)
+            counted_resolvers[i](Counted(i + 1));
+        run_once();
+        assert(total == 10 && Counted::copies == (keep ? 4 : 0));
+        if (keep)
+            assert(counted[3].result().value == 4);
+    }
+
+    // 空集合立即完成
+    bool empty_done = false;
+    when_all(Vec<Promise<void>>()).then_([&empty_done] { empty_done = true; });
+    run_once();
+    assert(empty_done);
+}
+
+#if __cplusplus >= 202002L
+
+static Async<int> delayed(int value, u32 ms) {
+    co_await sleep_ms(ms);
+    co_return value;
+}
+
+static Async<void> join_delayed(int count, int *sum, bool *done) {
+    Vec<Async<int>> children;
+    for (int i = 0; i < count; ++i)
+        children.push_back(delayed(i, 10 + i % 3));
+    Vec<int> results = co_await when_all(std::move(children));
+    for (size_t i = 0; i < results.size(); ++i)
+        *sum += results[i] * (int)(i + 1);
+    *done = true;
+}
+
+static Async<void> race_delayed(size_t *index, int *value, bool *done) {
+    Vec<Async<int>> children;
+    for (int i = 0; i < 4; ++i)
+        children.push_back(delayed(i * 100, 40 - i * 10));
+    AnyResult<int> any = co_await when_any(std::move(children));
+    *index = any.index;
+    children = Vec<Async<int>>();
+    children.push_back(delayed(1, 20));
+    children.push_back(delayed(2, 5));
+    *value = co_await race(std::move(children));
+    *done = true;
+}
+
+// 结束时记录完成或被取消
+struct Exit {
+    int *count;
+    ~Exit() { ++*count; }
+};
+
+static Async<int> tracked(int value, u32 ms, int *exited, bool *finished) {
+    Exit exit{exited};
+    co_await sleep_ms(ms);
+    *finished = true;
+    co_return value;
+}
+
+static Async<void> race_tracked(int *value, int *exited, bool *finished) {
+    Vec<Async<int>> children;
+    children.push_back(tracked(1, 1000, exited, finished));
+    children.push_back(tracked(2, 5, exited, finished + 1));
+    children.push_back(tracked(3, 2000, exited, finished + 2));
+    *value = co_await race(std::move(children));
+}
+
+static void test_when_async() {
+    use_virtual_clock();
+    // 64个子协程分三批到期, 汇合本身不产生额外的回调
+    int sum = 0;
+    bool done = false;
+    start_task_async([&sum, &done](Task *) { return join_delayed(64, &sum, &done); });
+    RunResult r = run_until([&done] { return done; });
+    assert(done && sum == 87360);
+    assert(r.work == 64 + 2); // 64个定时器 + 任务的启动和结束
+    run_once();
+    assert(get_frame_stats().live == 0);
+
+    // when_any取最快的子协程, 其余子协程随子任务结束
+    size_t index = 99;
+    int value = 0;
+    done = false;
+    start_task_async([&](Task *) { return race_delayed(&index, &value, &done); });
+    run_until([&done] { return done; });
+    assert(index == 3 && value == 2);
+    run_once();
+    assert(get_frame_stats().live == 0);
+
+    // 落败的子协程在等待中被销毁, 不会运行到结束
+    int exited = 0;
+    bool finished[3] = {false, false, false};
+    value = 0;
+    start_task_async([&](Task *) { return race_tracked(&value, &exited, finished); });
+    run_until([&value] { return value != 0; });
+    run_once();
+    assert(value == 2 && exited == 3 && get_frame_stats().live == 0);
+    run_for(3000);
+    assert(!finished[0] && finished[1] && !finished[2]);
+    use_system_clock();
+}
+
+#endif // __cplusplus >= 202002L
+
+void _test_when() {
+    printf("Test When\n");
+    test_when_promise();
+#if __cplusplus >= 202002L
+    test_when_async();
+#endif
+    printf("Test When PASS\n");
+}
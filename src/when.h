@@ -0,0 +1,289 @@
+#ifndef WHEN_H
+#define WHEN_H
+
+#include <promise.h>
+
+// 动态集合上的组合: when_all等待全部完成, when_any/race取最先完成的一个.
+// 子操作完成时同步计数, 不为每个子操作注册轮询节点, 每次完成O(1);
+// 全部(或第一个)完成时只唤醒等待者一次.
+
+// when_any的结果: 最先完成的子操作的下标及其结果, 结果不要求可默认构造
+template <typename T> struct AnyResult {
+    size_t index = 0;
+    Optional<T> value;
+};
+template <> struct AnyResult<void> {
+    size_t index = 0;
+};
+
+// 按下标收集的结果, 全部到齐后移动到结果数组
+template <typename T> Vec<T> _take_results(Vec<Optional<T>> &slots) {
+    Vec<T> results;
+    results.reserve(slots.size());
+    for (auto &v : slots)
+        results.push_back(std::move(*v));
+    return results;
+}
+
+// Promise: 通过listen挂在子Promise的resolve上, 聚合Promise在最后(第一)个子Promise resolve时resolve.
+// 子Promise被reject时: when_all随之reject, when_any在全部reject时reject, race取最先完成的一个.
+// 调用者已释放子Promise的句柄时结果直接移动过来, 否则复制(见Resolver::collect)
+template <typename T> auto when_all(const Vec<Promise<T>> &promises) {
+    if constexpr (std::is_void_v<T>) {
+        return Promise<void>([&promises](const Promise<void>::ResolveFunc &resolve) {
+            struct Join {
+                size_t remaining;
+                Promise<void>::ResolveFunc resolve;
+            };
+            auto join = make_shared<Join>(Join{promises.size(), resolve});
+            if (join->remaining == 0) {
+                resolve();
+                return;
+            }
+            for (auto &p : promises) {
+                p.listen_([join] {
+                    if (--join->remaining == 0)
+                        join->resolve();
+                });
+                p.listen_error([join](const PromiseError &e) { join->resolve.reject(e); });
+                resolve.depend_on(p);
+            }
+        });
+    } else {
+        using ResolveFunc = typename Promise<Vec<T>>::ResolveFunc;
+        return Promise<Vec<T>>([&promises](const ResolveFunc &resolve) {
+            struct Join {
+                Vec<Optional<T>> results;
+                size_t remaining;
+                ResolveFunc resolve;
+            };
+            auto join = make_shared<Join>(Join{Vec<Optional<T>>(promises.size()), promises.size(), resolve});
+            if (join->remaining == 0) {
+                resolve(Vec<T>());
+                return;
+            }
+            for (size_t i = 0; i < promises.size(); ++i) {
+                promises[i].listen_error([join](const PromiseError &e) { join->resolve.reject(e); });
+                resolve.collect(promises[i], [join, i](T &&result) {
+                    join->results[i].emplace(std::move(result));
+                    if (--join->remaining == 0)
+                        join->resolve(_take_results(join->results));
+                });
+                resolve.depend_on(promises[i]);
+            }
+        });
+    }
+}
+
+template <typename T> Promise<AnyResult<T>> when_any(const Vec<Promise<T>> &promises) {
+    assert(!promises.empty());
+    using ResolveFunc = typename Promise<AnyResult<T>>::ResolveFunc;
+    return Promise<AnyResult<T>>([&promises](const ResolveFunc &resolve) {
+        struct Join {
+            bool done;
+            size_t failed;
+            size_t total;
+            ResolveFunc resolve;
+        };
+        auto join = make_shared<Join>(Join{false, 0, promises.size(), resolve});
+        for (size_t i = 0; i < promises.size() && !join->done; ++i) {
+            promises[i].listen_error([join](const PromiseError &e) {
+                if (!join->done && ++join->failed == join->total) {
+                    join->done = true;
+                    join->resolve.reject(e);
+                }
+            });
+            resolve.collect(promises[i], [join, i](typename Promise<T>::Result &&result) {
+                if (join->done)
+                    return;
+                join->done = true;
+                AnyResult<T> any;
+                any.index = i;
+                if constexpr (!std::is_void_v<T>)
+                    any.value.emplace(std::move(result));
+                join->resolve(std::move(any));
+            });
+            resolve.depend_on(promises[i]);
+        }
+    });
+}
+
+template <typename T> Promise<T> race(const Vec<Promise<T>> &promises) {
+    assert(!promises.empty());
+    return Promise<T>([&promises](const typename Promise<T>::ResolveFunc &resolve) {
+        auto done = make_shared<bool>(false);
+        for (size_t i = 0; i < promises.size() && !*done; ++i) {
+            promises[i].listen_error([done, resolve](const PromiseError &e) {
+                if (!*done) {
+                    *done = true;
+                    resolve.reject(e);
+                }
+            });
+            if constexpr (std::is_void_v<T>) {
+                promises[i].listen_([done, resolve] {
+                    if (!*done) {
+                        *done = true;
+                        resolve();
+                    }
+                });
+            } else {
+                resolve.collect(promises[i], [done, resolve](T &&result) {
+                    if (!*done) {
+                        *done = true;
+                        resolve(std::move(result));
+                    }
+                });
+            }
+            resolve.depend_on(promises[i]);
+        }
+    });
+}
+
+#if __cplusplus >= 202002L
+
+#include <async.h>
+
+// Async: when_all的每个子协程由一个detach的辅助协程等待, 结束时在共享状态上计数,
+// 完成时直接恢复等待者, 不经过轮询节点.
+// when_any/race的每个子协程在独立的任务中运行(同with_timeout), 第一个完成后结束其余子任务,
+// 落败的子协程和它们的节点, 定时器随任务删除; 等待者被提前销毁时同样结束全部子任务.
+struct _WhenState {
+    size_t remaining = 0;           // 未完成的子协程数
+    bool finished = false;          // 组合已完成
+    std::coroutine_handle<> waiter; // 挂起等待的协程
+
+    void finish() {
+        finished = true;
+        if (waiter)
+            std::exchange(waiter, nullptr).resume();
+    }
+};
+
+// 等待者被销毁时清空waiter, 之后完成的子协程不再恢复它
+struct _WhenGuard {
+    _WhenState *st;
+    ~_WhenGuard() { st->waiter = nullptr; }
+};
+
+struct _WhenAwaiter {
+    _WhenState *st;
+    bool await_ready() const { return st->finished; }
+    void await_suspend(std::coroutine_handle<> h) { st->waiter = h; }
+    void await_resume() {}
+};
+
+template <typename T> struct _WhenAllState : _WhenState {
+    Vec<Optional<T>> results;
+};
+template <> struct _WhenAllState<void> : _WhenState {};
+
+template <typename T> Async<void> _when_all_child(Async<T> child, Shared<_WhenAllState<T>> st, size_t i) {
+    if constexpr (std::is_void_v<T>)
+        co_await child;
+    else
+        st->results[i].emplace(co_await child);
+    if (--st->remaining == 0)
+        st->finish();
+}
+
+template <typename T> using WhenAllResult = std::conditional_t<std::is_void_v<T>, void, Vec<T>>;
+
+template <typename T> Async<WhenAllResult<T>> when_all(Vec<Async<T>> children) {
+    auto st = make_shared<_WhenAllState<T>>();
+    st->remaining = children.size();
+    if constexpr (!std::is_void_v<T>)
+        st->results.resize(children.size());
+    st->finished = children.empty();
+    for (size_t i = 0; i < children.size(); ++i)
+        _when_all_child(std::move(children[i]), st, i).detach();
+    _WhenGuard guard{st.get()};
+    co_await _WhenAwaiter{st.get()};
+    if constexpr (!std::is_void_v<T>)
+        co_return _take_results(st->results);
+}
+
+// 子任务中完成时唤醒等待节点, 等待者在自己的任务中下一轮恢复
+template <typename T> struct _WhenAnyState {
+    AnyResult<T> result;
+    bool finished = false;
+    Poll waiter;
+};
+
+template <typename T> Async<void> _when_any_child(Async<T> child, Shared<_WhenAnyState<T>> st, size_t i) {
+    if constexpr (std::is_void_v<T>) {
+        co_await child;
+        if (!st->finished) {
+            st->result.index = i;
+            st->finished = true;
+            st->waiter.wake();
+        }
+    } else {
+        T result = co_await child;
+        if (!st->finished) {
+            st->result.index = i;
+            st->result.value.emplace(std::move(result));
+            st->finished = true;
+            st->waiter.wake();
+        }
+    }
+}
+
+// when_any结束(或被销毁)时删除等待节点并结束全部子任务, 已经结束的任务不受影响
+struct _WhenAnyTasks {
+    Vec<Shared<Task>> tasks;
+    Poll *waiter;
+    ~_WhenAnyTasks() {
+        waiter->remove();
+        for (auto &task : tasks)
+            task->terminal();
+    }
+};
+
+template <typename T> struct _WhenAnyAwaiter {
+    _WhenAnyState<T> *st;
+    bool await_ready() const { return st->finished; }
+    void await_suspend(std::coroutine_handle<> h) {
+        auto st = this->st;
+        st->waiter = set_poll([st, h](Poll p) {
+            if (st->finished) {
+                p.remove();
+                h.resume();
+            } else {
+                p.park();
+            }
+        });
+        st->waiter.park();
+    }
+    void await_resume() {}
+};
+
+template <typename T> Async<AnyResult<T>> when_any(Vec<Async<T>> children) {
+    assert(!children.empty());
+    auto st = make_shared<_WhenAnyState<T>>();
+    _WhenAnyTasks guard{{}, &st->waiter};
+    guard.tasks.reserve(children.size());
+    for (size_t i = 0; i < children.size(); ++i) {
+        auto holder = make_shared<Async<T>>(std::move(children[i]));
+        guard.tasks.push_back(start_task("when_any", [holder, st, i](Task *) {
+            if (!st->finished)
+                _when_any_child(std::move(*holder), st, i).detach();
+        }));
+    }
+    co_await _WhenAnyAwaiter<T>{st.get()};
+    co_return std::move(st->result);
+}
+
+template <typename T> Async<T> race(Vec<Async<T>> children) {
+    if constexpr (std::is_void_v<T>) {
+        co_await when_any(std::move(children));
+    } else {
+        AnyResult<T> any = co_await when_any(std::move(children));
+        co_return std::move(*any.value);
+    }
+}
+
+#endif // __cplusplus >= 202002L
+
+extern void _test_when();
+
+#endif // WHEN_H
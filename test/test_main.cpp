@@ -1,6 +1,20 @@
 #include <stdio.h>
 
 #include <types.h>
+#include <poll.h>
+#include <timeout.h>
+#include <async.h>
+#include <frame_pool.h>
+#include <rc.h>
+#include <async_generator.h>
+#include <stream.h>
+#include <broadcast.h>
+#include <promise.h>
+#include <when.h>
+#include <deadline.h>
+#include <sync.h>
+#include <channel.h>
+#include <task_group.h>
 
 // extern void _test_types();
 // extern void _test_poll();
@@ -8,12 +22,26 @@
 // extern void _test_buf();
 // extern void _test_str();
 // extern void _test_uart_buf();
-// extern void _test_promise();
 
 int main() {
     printf("========== Lib MCU Async Test ==========\n");
 
     _test_enum();
+    _test_func();
+    _test_poll();
+    _test_timeout();
+    _test_frame_pool();
+    _test_rc();
+    _test_async();
+    _test_stream();
+    _test_broadcast();
+    _test_async_generator();
+    _test_promise();
+    _test_when();
+    _test_deadline();
+    _test_sync();
+    _test_channel();
+    _test_task_group();
     
     printf("========== Test End ==========\n");
     return 0;